@@ -0,0 +1,113 @@
+// Throughput of a 3-stage pipeline (writer | cat | reader) per pipe size
+// Usage: pipe_bench [megabytes] [write_kb]
+// The middle stage is a real `cat` started through launch_process, the
+// ends are a forked writer and this process reading, so the numbers are
+// the pipe and context-switch cost a shell pipeline pays.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include "launcher.h"
+#include "variables.h"
+
+static const int pipe_sizes[] = {0, 16 << 10, 64 << 10, 256 << 10, 1 << 20};
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n <= 0) _exit(1);
+        buf += n;
+        len -= n;
+    }
+}
+
+// MB/s pushing total bytes through writer | cat | reader
+static double run(int pipe_size, size_t total, size_t chunk) {
+    int first[2], second[2];
+    if (open_pipe(first, pipe_size) == -1 || open_pipe(second, pipe_size) == -1) {
+        perror("open_pipe");
+        exit(1);
+    }
+
+    char *buf = malloc(chunk);
+    if (!buf) {
+        perror("malloc");
+        exit(1);
+    }
+    memset(buf, 'x', chunk);
+
+    double start = now_sec();
+
+    pid_t writer = fork();
+    if (writer == 0) {
+        close(first[0]);
+        close(second[0]);
+        close(second[1]);
+        for (size_t sent = 0; sent < total; sent += chunk) {
+            write_all(first[1], buf, chunk);
+        }
+        _exit(0);
+    }
+
+    char *args[] = {"cat", NULL};
+    launch_spec_t spec = {
+        .args = args,
+        .stdin_fd = first[0],
+        .stdout_fd = second[1],
+    };
+    pid_t cat = launch_process(&spec);
+    if (writer < 0 || cat < 0) {
+        perror("launch");
+        exit(1);
+    }
+
+    close(first[0]);
+    close(first[1]);
+    close(second[1]);
+
+    size_t received = 0;
+    ssize_t n;
+    while ((n = read(second[0], buf, chunk)) > 0) {
+        received += n;
+    }
+    close(second[0]);
+
+    waitpid(writer, NULL, 0);
+    waitpid(cat, NULL, 0);
+    double elapsed = now_sec() - start;
+    free(buf);
+
+    if (received != total) {
+        fprintf(stderr, "short pipeline: %zu of %zu bytes\n", received, total);
+        exit(1);
+    }
+    return total / (1024.0 * 1024.0) / elapsed;
+}
+
+int main(int argc, char *argv[]) {
+    size_t megabytes = argc > 1 ? (size_t)atoi(argv[1]) : 1024;
+    size_t chunk = (argc > 2 ? (size_t)atoi(argv[2]) : 128) << 10;
+
+    init_variables();   // PATH lookup for cat
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("data: %zu MB, writes of %zu KB\n", megabytes, chunk >> 10);
+    for (size_t i = 0; i < sizeof(pipe_sizes) / sizeof(pipe_sizes[0]); i++) {
+        double rate = run(pipe_sizes[i], megabytes << 20, chunk);
+        if (pipe_sizes[i]) {
+            printf("pipe %5d KB: %8.0f MB/s\n", pipe_sizes[i] >> 10, rate);
+        } else {
+            printf("pipe default: %8.0f MB/s\n", rate);
+        }
+    }
+    return 0;
+}
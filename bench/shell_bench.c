@@ -0,0 +1,385 @@
+// Shell hot paths, as numbers a script can check
+// Usage: shell_bench [--json FILE] [--csv FILE] [--baseline FILE] [--tolerance PCT]
+// Every result is a rate (higher is better), best of BENCH_REPEATS runs.
+// With --baseline (a CSV written by --csv), a result more than PCT percent
+// (default 25) below its baseline is a regression and the exit status is 1.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "arena.h"
+#include "executor.h"
+#include "history.h"
+#include "jobs.h"
+#include "parsers.h"
+#include "utils.h"
+#include "variables.h"
+
+#define BENCH_REPEATS 3
+#define BENCH_MIN_SECONDS 0.25      // each timed loop runs at least this long
+#define BENCH_MAX 32
+#define BENCH_VARS 10000
+#define BENCH_EXPAND_REFS 100
+#define BENCH_HISTORY 100000
+#define BENCH_PARSE_BYTES (256 << 10)
+#define BENCH_PIPE_MB 256
+
+typedef struct {
+    const char *name;
+    const char *unit;
+    double (*run)(void);
+} bench_t;
+
+typedef struct {
+    const char *name;
+    const char *unit;
+    double value;
+    double baseline;    // 0 = none
+} result_t;
+
+static arena_t line_arena;
+static char *var_names[BENCH_VARS];
+static char *history_lines[BENCH_HISTORY];
+static char *long_line;
+static char *expand_input;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Grow the batch until one takes BENCH_MIN_SECONDS; ops per second
+static double ops_per_sec(void (*op)(long count)) {
+    for (long count = 1;; count *= 2) {
+        double start = now_sec();
+        op(count);
+        double elapsed = now_sec() - start;
+        if (elapsed >= BENCH_MIN_SECONDS) {
+            return count / elapsed;
+        }
+    }
+}
+
+// What main()'s execute_line does for one input line
+static void run_line(const char *input) {
+    parsed_line_t *line = parse_command_line(input);
+    if (!line) {
+        fprintf(stderr, "shell_bench: can't parse '%.40s'\n", input);
+        exit(1);
+    }
+    execute_ast(line->ast, &line_arena);
+    release_command_line(line);
+    arena_reset(&line_arena);
+}
+
+// =================================================================
+// Commands
+// =================================================================
+
+static void builtin_op(long count) {
+    for (long i = 0; i < count; i++) run_line("set +o pipefail");
+}
+
+static void external_op(long count) {
+    for (long i = 0; i < count; i++) run_line("true");
+}
+
+// The interactive loop minus readline: jobs, history, execute, prompt
+static void main_loop_op(long count) {
+    static long serial = 0;
+    char input[64];
+
+    for (long i = 0; i < count; i++) {
+        snprintf(input, sizeof(input), "unset BENCH_N%ld", serial++);
+        jobs_poll();
+        jobs_notify();
+        add_to_history(input);
+        save_history_to_file();
+        run_line(input);
+        prompt_command_finished(0);
+        render_prompt();
+    }
+}
+
+static double bench_builtin(void) { return ops_per_sec(builtin_op); }
+static double bench_external(void) { return ops_per_sec(external_op); }
+static double bench_main_loop(void) { return ops_per_sec(main_loop_op); }
+
+// =================================================================
+// Parsing
+// =================================================================
+
+static void parse_op(long count) {
+    for (long i = 0; i < count; i++) {
+        parsed_line_t *line = parse_command_line(long_line);
+        release_command_line(line);
+        clear_parse_cache();    // every round is a miss
+    }
+}
+
+static double bench_parse(void) {
+    return ops_per_sec(parse_op) * strlen(long_line) / (1024.0 * 1024.0);
+}
+
+// =================================================================
+// Variables
+// =================================================================
+
+static void var_set_op(long count) {
+    for (long i = 0; i < count; i++) set_variable(var_names[i % BENCH_VARS], "value", 0);
+}
+
+static void var_get_op(long count) {
+    static volatile const char *sink;
+    for (long i = 0; i < count; i++) sink = get_variable(var_names[(i * 7919) % BENCH_VARS]);
+    (void)sink;
+}
+
+static void var_expand_op(long count) {
+    for (long i = 0; i < count; i++) free(expand_variables(expand_input));
+}
+
+static double bench_var_set(void) { return ops_per_sec(var_set_op); }
+static double bench_var_get(void) { return ops_per_sec(var_get_op); }
+static double bench_var_expand(void) { return ops_per_sec(var_expand_op); }
+
+// =================================================================
+// History (BENCH_HISTORY entries)
+// =================================================================
+
+static const char *history_path;
+
+static void fill_history(void) {
+    clear_history_entries();
+    for (int i = 0; i < BENCH_HISTORY; i++) add_to_history(history_lines[i]);
+}
+
+// One round is too quick to time alone: repeat it, timing only `timed`
+static double history_rate(void (*prepare)(void), void (*timed)(void)) {
+    double spent = 0;
+    long rounds = 0;
+    while (spent < BENCH_MIN_SECONDS) {
+        if (prepare) prepare();
+        double start = now_sec();
+        timed();
+        spent += now_sec() - start;
+        rounds++;
+    }
+    return rounds * BENCH_HISTORY / spent;
+}
+
+static void add_all(void) {
+    for (int i = 0; i < BENCH_HISTORY; i++) add_to_history(history_lines[i]);
+}
+
+static void fill_unsaved(void) {
+    fill_history();
+    unlink(history_path);
+}
+
+static double bench_history_add(void) {
+    return history_rate(clear_history_entries, add_all);
+}
+
+static double bench_history_save(void) {
+    return history_rate(fill_unsaved, save_history_to_file);
+}
+
+static double bench_history_load(void) {
+    fill_unsaved();
+    save_history_to_file();
+    return history_rate(clear_history_entries, init_history);
+}
+
+// =================================================================
+// Pipelines
+// =================================================================
+
+static double bench_pipeline(void) {
+    char input[128];
+    snprintf(input, sizeof(input), "head -c %d /dev/zero | cat | cat > /dev/null", BENCH_PIPE_MB << 20);
+    double start = now_sec();
+    run_line(input);
+    return BENCH_PIPE_MB / (now_sec() - start);
+}
+
+static const bench_t benches[] = {
+    {"builtin_commands",  "cmd/s",   bench_builtin},
+    {"external_commands", "cmd/s",   bench_external},
+    {"main_loop_lines",   "line/s",  bench_main_loop},
+    {"parse_long_line",   "MB/s",    bench_parse},
+    {"var_set_10k",       "op/s",    bench_var_set},
+    {"var_get_10k",       "op/s",    bench_var_get},
+    {"var_expand_100ref", "op/s",    bench_var_expand},
+    {"history_add_100k",  "entry/s", bench_history_add},
+    {"history_save_100k", "entry/s", bench_history_save},
+    {"history_load_100k", "entry/s", bench_history_load},
+    {"pipeline_3_stage",  "MB/s",    bench_pipeline},
+};
+
+// =================================================================
+// Setup, output, baseline
+// =================================================================
+
+static void setup(char *home) {
+    init_variables();
+    arena_init(&line_arena);
+
+    // History lives in a scratch HOME, big enough to hold every entry
+    set_variable("HOME", home, 0);
+    set_variable("HISTSIZE", "100000", 0);
+    set_variable("NUTSHELL_HISTFILE_MAX", "1073741824", 0);
+    init_history();
+    init_prompt();
+
+    char name[32];
+    for (int i = 0; i < BENCH_VARS; i++) {
+        snprintf(name, sizeof(name), "BENCH_VAR_%d", i);
+        var_names[i] = strdup(name);
+        set_variable(name, "some value", 0);
+    }
+
+    // @BENCH_VAR_n references spread over the table, with text between
+    size_t cap = BENCH_EXPAND_REFS * 32;
+    expand_input = malloc(cap);
+    size_t len = 0;
+    for (int i = 0; i < BENCH_EXPAND_REFS; i++) {
+        len += snprintf(expand_input + len, cap - len, "x/@BENCH_VAR_%d ", (i * 97) % BENCH_VARS);
+    }
+
+    char line[128];
+    for (int i = 0; i < BENCH_HISTORY; i++) {
+        snprintf(line, sizeof(line), "make -C src/module%d target%d && echo done", i % 500, i);
+        history_lines[i] = strdup(line);
+    }
+
+    // Words, quotes, references, redirections and pipes, ~BENCH_PARSE_BYTES
+    static const char *chunk = "grep -n 'some pattern' \"@HOME/file name\" --flag=value @BENCH_VAR_1 > out.txt | ";
+    size_t chunk_len = strlen(chunk);
+    long_line = malloc(BENCH_PARSE_BYTES + 16);
+    len = 0;
+    while (len + chunk_len < BENCH_PARSE_BYTES) {
+        memcpy(long_line + len, chunk, chunk_len);
+        len += chunk_len;
+    }
+    strcpy(long_line + len, "tail");
+}
+
+static int load_baseline(const char *path, result_t *results, int count) {
+    FILE *in = fopen(path, "r");
+    if (!in) {
+        perror(path);
+        return -1;
+    }
+
+    char line[256], name[128], unit[32];
+    double value;
+    while (fgets(line, sizeof(line), in)) {
+        if (sscanf(line, "%127[^,],%31[^,],%lf", name, unit, &value) != 3) continue;
+        for (int i = 0; i < count; i++) {
+            if (strcmp(results[i].name, name) == 0) results[i].baseline = value;
+        }
+    }
+    fclose(in);
+    return 0;
+}
+
+static int write_csv(const char *path, const result_t *results, int count) {
+    FILE *out = fopen(path, "w");
+    if (!out) return -1;
+    fprintf(out, "name,unit,value\n");
+    for (int i = 0; i < count; i++) {
+        fprintf(out, "%s,%s,%.1f\n", results[i].name, results[i].unit, results[i].value);
+    }
+    return fclose(out);
+}
+
+static int write_json(const char *path, const result_t *results, int count, double tolerance) {
+    FILE *out = fopen(path, "w");
+    if (!out) return -1;
+    fprintf(out, "{\n  \"tolerance_pct\": %.1f,\n  \"results\": [\n", tolerance);
+    for (int i = 0; i < count; i++) {
+        fprintf(out, "    {\"name\": \"%s\", \"unit\": \"%s\", \"value\": %.1f",
+                results[i].name, results[i].unit, results[i].value);
+        if (results[i].baseline > 0) {
+            fprintf(out, ", \"baseline\": %.1f, \"change_pct\": %.1f", results[i].baseline,
+                    (results[i].value / results[i].baseline - 1) * 100);
+        }
+        fprintf(out, "}%s\n", i + 1 < count ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+    return fclose(out);
+}
+
+int main(int argc, char *argv[]) {
+    const char *json_path = NULL, *csv_path = NULL, *baseline_path = NULL;
+    double tolerance = 25;
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 < argc && strcmp(argv[i], "--json") == 0) json_path = argv[++i];
+        else if (i + 1 < argc && strcmp(argv[i], "--csv") == 0) csv_path = argv[++i];
+        else if (i + 1 < argc && strcmp(argv[i], "--baseline") == 0) baseline_path = argv[++i];
+        else if (i + 1 < argc && strcmp(argv[i], "--tolerance") == 0) tolerance = atof(argv[++i]);
+        else {
+            fprintf(stderr, "Usage: %s [--json FILE] [--csv FILE] [--baseline FILE] [--tolerance PCT]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    char home[] = "/tmp/nutshell_bench.XXXXXX";
+    if (!mkdtemp(home)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    char path[sizeof(home) + 32];
+    snprintf(path, sizeof(path), "%s/%s", home, HISTORY_FILE);
+    history_path = path;
+    setup(home);
+
+    int count = sizeof(benches) / sizeof(benches[0]);
+    result_t results[BENCH_MAX];
+    for (int i = 0; i < count; i++) {
+        results[i] = (result_t){benches[i].name, benches[i].unit, 0, 0};
+        for (int r = 0; r < BENCH_REPEATS; r++) {
+            double value = benches[i].run();
+            if (value > results[i].value) results[i].value = value;
+        }
+        fprintf(stderr, ".");
+    }
+    fprintf(stderr, "\n");
+
+    unlink(path);
+    rmdir(home);
+
+    if (baseline_path && load_baseline(baseline_path, results, count) != 0) {
+        return 1;
+    }
+
+    int regressions = 0;
+    printf("%-20s %12s %-7s %12s %8s\n", "benchmark", "value", "", "baseline", "change");
+    for (int i = 0; i < count; i++) {
+        const result_t *res = &results[i];
+        printf("%-20s %12.1f %-7s", res->name, res->value, res->unit);
+        if (res->baseline > 0) {
+            double change = (res->value / res->baseline - 1) * 100;
+            int regressed = change < -tolerance;
+            regressions += regressed;
+            printf(" %12.1f %+7.1f%%%s", res->baseline, change, regressed ? "  REGRESSION" : "");
+        }
+        printf("\n");
+    }
+
+    if ((csv_path && write_csv(csv_path, results, count) != 0) ||
+        (json_path && write_json(json_path, results, count, tolerance) != 0)) {
+        perror("shell_bench: writing results");
+        return 1;
+    }
+
+    if (regressions) {
+        printf("%d benchmark(s) more than %.0f%% below baseline\n", regressions, tolerance);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,154 @@
+// Tokenizer throughput on large generated command lines
+// Usage: tokenize_bench [args] [reps]
+// Compares the old isspace()/compare-chain scanner, the table-driven scalar
+// fallback and the SSE2/AVX2 block classifiers, and checks that every
+// backend produces the same tokens.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ctype.h>
+#include "tokenizer.h"
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Mix of what real lines look like: plain words, paths, quoted strings,
+// options and the odd operator/redirection
+static char *generate_line(int args) {
+    size_t cap = (size_t)args * 48 + 64;
+    char *line = malloc(cap);
+    if (!line) return NULL;
+
+    size_t len = snprintf(line, cap, "command");
+    for (int i = 0; i < args; i++) {
+        switch (i % 8) {
+            case 0: len += snprintf(line + len, cap - len, " --option-number-%d", i); break;
+            case 1: len += snprintf(line + len, cap - len, " /usr/share/some/longer/path/file_%d.txt", i); break;
+            case 2: len += snprintf(line + len, cap - len, " \"quoted argument with spaces %d\"", i); break;
+            case 3: len += snprintf(line + len, cap - len, " 'single | quoted > %d'", i); break;
+            case 4: len += snprintf(line + len, cap - len, " plainword%d", i); break;
+            case 5: len += snprintf(line + len, cap - len, " key=value_%d", i); break;
+            case 6: len += snprintf(line + len, cap - len, " 2> err_%d.log", i); break;
+            case 7: len += snprintf(line + len, cap - len, " | filter_%d", i); break;
+        }
+    }
+    return line;
+}
+
+// The pre-SIMD scanner: isspace() plus a chain of operator compares per byte
+// (token slices instead of strdup, so only the scanning is compared)
+static int legacy_tokenize(const char *input, token_t *tokens, int cap) {
+    const char *pos = input;
+    int count = 0;
+
+    while (*pos && count < cap - 1) {
+        while (isspace((unsigned char)*pos)) pos++;
+        if (!*pos) break;
+
+        token_t *token = &tokens[count++];
+        token->start = pos;
+        token->type = TOKEN_WORD;
+
+        if ((*pos == '&' && pos[1] == '&') || (*pos == '|' && pos[1] == '|') ||
+            (*pos == '>' && pos[1] == '>') || (*pos == '&' && pos[1] == '>') ||
+            (*pos == '2' && pos[1] == '>')) {
+            token->type = TOKEN_AND;
+            pos += 2;
+        } else if (*pos == '>' || *pos == '<' || *pos == '|' || *pos == '&' ||
+                   *pos == ';' || *pos == '(' || *pos == ')') {
+            token->type = TOKEN_PIPE;
+            pos++;
+        } else if (*pos == '"' || *pos == '\'') {
+            char quote_char = *pos++;
+            while (*pos && *pos != quote_char) pos++;
+            if (*pos) pos++;
+        } else {
+            while (*pos && !isspace((unsigned char)*pos) && *pos != '&' && *pos != ';' &&
+                   *pos != '|' && *pos != '>' && *pos != '<') {
+                pos++;
+            }
+        }
+        token->len = pos - token->start;
+    }
+    return count;
+}
+
+static int same_tokens(const token_buf_t *a, const token_buf_t *b) {
+    if (a->count != b->count) return 0;
+    for (int i = 0; i < a->count; i++) {
+        if (a->tokens[i].type != b->tokens[i].type ||
+            a->tokens[i].start != b->tokens[i].start ||
+            a->tokens[i].len != b->tokens[i].len) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    int args = argc > 1 ? atoi(argv[1]) : 20000;
+    int reps = argc > 2 ? atoi(argv[2]) : 200;
+
+    char *line = generate_line(args);
+    if (!line) {
+        perror("malloc");
+        return 1;
+    }
+    size_t len = strlen(line);
+
+    token_buf_t reference;
+    token_buf_init(&reference);
+    set_tokenizer_backend(TOKENIZER_SCALAR);
+    tokenize(line, &reference);
+
+    printf("line: %zu bytes, %d args, %d tokens, %d reps\n", len, args, reference.count, reps);
+
+    // Baseline: the scanner this tokenizer replaced
+    int legacy_cap = reference.count + 1;
+    token_t *legacy_tokens = malloc(legacy_cap * sizeof(token_t));
+    double start = now_sec();
+    for (int r = 0; r < reps; r++) {
+        legacy_tokenize(line, legacy_tokens, legacy_cap);
+    }
+    double legacy_time = now_sec() - start;
+    free(legacy_tokens);
+
+    printf("%-7s %8.1f MB/s  %8.2f ms/line  %5.2fx\n", "legacy",
+           (double)len * reps / legacy_time / 1e6, legacy_time * 1000 / reps, 1.0);
+
+    tokenizer_backend_t backends[] = {TOKENIZER_SCALAR, TOKENIZER_SSE2, TOKENIZER_AVX2};
+    int failed = 0;
+
+    for (int b = 0; b < 3; b++) {
+        if (set_tokenizer_backend(backends[b]) != 0) {
+            printf("%-7s unavailable\n", b == 1 ? "sse2" : "avx2");
+            continue;
+        }
+
+        token_buf_t buf;
+        token_buf_init(&buf);
+
+        double start = now_sec();
+        for (int r = 0; r < reps; r++) {
+            tokenize(line, &buf);
+        }
+        double elapsed = now_sec() - start;
+
+        if (!same_tokens(&buf, &reference)) {
+            printf("%-7s MISMATCH against scalar tokens\n", tokenizer_backend_name());
+            failed = 1;
+        }
+
+        printf("%-7s %8.1f MB/s  %8.2f ms/line  %5.2fx\n", tokenizer_backend_name(),
+               (double)len * reps / elapsed / 1e6, elapsed * 1000 / reps, legacy_time / elapsed);
+        token_buf_free(&buf);
+    }
+
+    token_buf_free(&reference);
+    free(line);
+    return failed;
+}
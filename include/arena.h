@@ -0,0 +1,34 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdalign.h>
+
+#define ARENA_BLOCK_SIZE 4096
+
+// One chunk of bump-allocated memory
+typedef struct arena_block {
+    struct arena_block *next;
+    size_t size;
+    size_t used;
+    alignas(max_align_t) char data[];   // malloc'd, so every size step stays aligned
+} arena_block_t;
+
+// Per-line allocator: everything parsed from one input line lives here
+// and is released at once with arena_reset()
+typedef struct {
+    arena_block_t *first;   // kept across resets
+    arena_block_t *current; // block we're bumping in
+} arena_t;
+
+void arena_init(arena_t *arena);
+void* arena_alloc(arena_t *arena, size_t size);
+char* arena_strndup(arena_t *arena, const char *str, size_t len);
+
+// Forget every allocation; O(1) unless the line overflowed the first block
+void arena_reset(arena_t *arena);
+
+// Free all memory held by the arena
+void arena_destroy(arena_t *arena);
+
+#endif
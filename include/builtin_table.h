@@ -0,0 +1,43 @@
+#ifndef BUILTIN_TABLE_H
+#define BUILTIN_TABLE_H
+
+// The one list of builtins. Each entry is X(name, handler, flags).
+// tools/gen_builtin_hash.c reads this at build time and emits a perfect
+// hash (obj/builtin_hash.h), so adding a line here is all it takes.
+
+#define BUILTIN_SHELL_STATE 0x1     // changes the shell itself, never forked when run alone
+#define BUILTIN_CHILD_OK    0x2     // may run in a forked child (pipeline stage, &)
+
+#define BUILTIN_LIST(X) \
+    X("exit",        builtin_exit,        BUILTIN_SHELL_STATE) \
+    X("cdir",        builtin_cdir,        BUILTIN_SHELL_STATE) \
+    X("pcd",         builtin_pcd,         BUILTIN_CHILD_OK) \
+    X("history",     builtin_history,     BUILTIN_CHILD_OK) \
+    X("hash",        builtin_hash,        BUILTIN_SHELL_STATE | BUILTIN_CHILD_OK) \
+    X("export",      builtin_export,      BUILTIN_SHELL_STATE | BUILTIN_CHILD_OK) \
+    X("set",         builtin_set,         BUILTIN_SHELL_STATE | BUILTIN_CHILD_OK) \
+    X("unset",       builtin_unset,       BUILTIN_SHELL_STATE | BUILTIN_CHILD_OK) \
+    X("env",         builtin_env,         BUILTIN_CHILD_OK) \
+    X("debug",       builtin_debug,       BUILTIN_SHELL_STATE) \
+    X("timing",      builtin_timing,      BUILTIN_CHILD_OK) \
+    X("trace",       builtin_trace,       BUILTIN_SHELL_STATE) \
+    X("clearscreen", builtin_clearscreen, BUILTIN_CHILD_OK) \
+    X("fcat",        builtin_fcat,        BUILTIN_CHILD_OK) \
+    X("parallel",    builtin_parallel,    BUILTIN_SHELL_STATE | BUILTIN_CHILD_OK) \
+    X("jobs",        builtin_jobs,        BUILTIN_CHILD_OK) \
+    X("fg",          builtin_fg,          BUILTIN_SHELL_STATE) \
+    X("bg",          builtin_bg,          BUILTIN_SHELL_STATE) \
+    X("wait",        builtin_wait,        BUILTIN_SHELL_STATE) \
+    X("kill",        builtin_kill,        BUILTIN_CHILD_OK)
+
+// FNV-1a with a seed, shared by the generator and the lookup
+static inline unsigned int builtin_name_hash(const char *name, unsigned int seed) {
+    unsigned int h = 2166136261u ^ seed;
+    while (*name) {
+        h ^= (unsigned char)*name++;
+        h *= 16777619u;
+    }
+    return h ^ (h >> 15);
+}
+
+#endif
@@ -1,6 +1,17 @@
 #ifndef BUILTINS_H
 #define BUILTINS_H
 
-int handle_builtin(char **args);
+#include "builtin_table.h"
+
+typedef int (*builtin_fn)(char **args);    // returns the exit status
+
+typedef struct {
+    const char *name;
+    builtin_fn handler;
+    int flags;              // BUILTIN_SHELL_STATE, BUILTIN_CHILD_OK
+} builtin_t;
+
+const builtin_t* find_builtin(const char *name);    // NULL if not a builtin
+int run_builtin(const builtin_t *builtin, char **args);
 
 #endif
@@ -12,31 +12,50 @@ typedef enum {
     DEBUG_VERBOSE = 4   // Detailed tracing
 } debug_level_t;
 
+// Compile-time ceiling: messages above it are not compiled in at all, so
+// a release build pays nothing for the INFO/VERBOSE calls on hot paths.
+// `debug <level>` still works at or below it.
+#ifndef NUTSHELL_MAX_DEBUG_LEVEL
+#define NUTSHELL_MAX_DEBUG_LEVEL DEBUG_VERBOSE
+#endif
+
+// Level a build starts at (the Makefile targets pass their own)
+#ifndef DEFAULT_DEBUG_LEVEL
+#define DEFAULT_DEBUG_LEVEL DEBUG_NONE
+#endif
+
+#define DEBUG_SINK_BUFFER 8192      // bytes held before the sink writes
+
 // Global debug state
 extern debug_level_t g_debug_level;
 
-// Debug macros
-#define DEBUG_ERROR(fmt, ...) \
-    do { if (g_debug_level >= DEBUG_ERROR) \
-         fprintf(stderr, "[ERROR] " fmt "\n", ##__VA_ARGS__); } while(0)
-
-#define DEBUG_WARN(fmt, ...) \
-    do { if (g_debug_level >= DEBUG_WARN) \
-         fprintf(stderr, "[WARN] " fmt "\n", ##__VA_ARGS__); } while(0)
+// Messages go to a buffered sink (stderr, or a file) shared by all threads
+void debug_log(debug_level_t level, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
 
-#define DEBUG_INFO(fmt, ...) \
-    do { if (g_debug_level >= DEBUG_INFO) \
-         fprintf(stderr, "[INFO] " fmt "\n", ##__VA_ARGS__); } while(0)
+// Debug macros: a constant-false first test when over the ceiling
+#define DEBUG_LOG_AT(level, fmt, ...) \
+    do { if (NUTSHELL_MAX_DEBUG_LEVEL >= (level) && g_debug_level >= (level)) \
+         debug_log((level), fmt, ##__VA_ARGS__); } while(0)
 
-#define DEBUG_VERBOSE(fmt, ...) \
-    do { if (g_debug_level >= DEBUG_VERBOSE) \
-         fprintf(stderr, "[DEBUG] " fmt "\n", ##__VA_ARGS__); } while(0)
+#define DEBUG_ERROR(fmt, ...)   DEBUG_LOG_AT(DEBUG_ERROR, fmt, ##__VA_ARGS__)
+#define DEBUG_WARN(fmt, ...)    DEBUG_LOG_AT(DEBUG_WARN, fmt, ##__VA_ARGS__)
+#define DEBUG_INFO(fmt, ...)    DEBUG_LOG_AT(DEBUG_INFO, fmt, ##__VA_ARGS__)
+#define DEBUG_VERBOSE(fmt, ...) DEBUG_LOG_AT(DEBUG_VERBOSE, fmt, ##__VA_ARGS__)
 
 // Convenience macros
 #define DEBUG_PRINT(fmt, ...) DEBUG_VERBOSE(fmt, ##__VA_ARGS__)
 
-// Function to set debug level
-void set_debug_level(debug_level_t level);
+// Set the debug level, clamped to the ceiling. Returns the level in effect.
+debug_level_t set_debug_level(debug_level_t level);
 const char* debug_level_to_string(debug_level_t level);
 
+// Where messages go: a file (appended to), or stderr for NULL / "-".
+// Returns 0, or -1 if the file can't be opened (sink unchanged).
+int debug_set_output(const char *path);
+const char* debug_output_name(void);
+
+// Write out whatever is buffered (before a prompt, at exit, before fork)
+void debug_flush(void);
+
 #endif
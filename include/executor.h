@@ -3,12 +3,14 @@
 
 #include "parsers.h"
 
-void execute_command(char **args, int is_background);
-void execute_command_with_redirections(command_t *cmd); // handle redirection commands
-void execute_pipeline(command_t *commands, int cmd_count, int is_background);  // handle pipeline execution
+// One job for the whole pipeline: every stage started, then all waited for
+// (or handed to the job table with &). Called for each NODE_PIPELINE, so
+// &&, || and ; see the status of the pipeline as a whole.
+int execute_pipeline(command_t *commands, int cmd_count, int is_background);
 
-
-int execute_external_command_with_status(char **args, int is_background);
+// Walk a parsed line: lists, &&/||, pipelines and subshells
+// Word expansion happens here, into the per-line arena
+int execute_ast(const ast_node_t *node, arena_t *arena);
 
 
 #endif
@@ -1,8 +1,21 @@
 #ifndef HISTORY_H
 #define HISTORY_H
 
-#define MAX_HISTORY 1000
+#define DEFAULT_HISTSIZE 1000         // entries kept when HISTSIZE isn't set
 #define HISTORY_FILE ".nutshell_history"
+#define HISTORY_FILE_MAX (1024 * 1024)  // bytes before compaction (NUTSHELL_HISTFILE_MAX)
+#define HISTORY_IOV_BATCH 512           // iovecs per writev, even (text + newline)
+#define TRIGRAM_BITS 14                 // 16k trigram buckets in the search index
+#define TRIGRAM_BUCKETS (1 << TRIGRAM_BITS)
+#define HISTORY_SEARCH_MAX 50           // results shown by history -s / cycled by Ctrl-R
+#define HISTORY_RECENCY_SCALE 100.0     // commands of age that halve a match's score
+
+typedef struct {
+    const char *text;   // valid until history changes
+    int number;         // newest occurrence, as shown by history
+    int count;          // times it appears in history
+    double score;
+} history_match_t;
 
 // Initialize history system (loads from file)
 void init_history(void);
@@ -13,12 +26,22 @@ void add_to_history(const char *cmd);
 // Print current session history
 void print_history(void);
 
-// Save all history to file (called on exit/signal)
+// Search entries containing pattern (trigram index), best match first
+int search_history(const char *pattern, history_match_t *out, int max);
+void print_history_matches(const char *pattern);   // history -s
+
+// Bind Ctrl-R to the indexed search (interactive only)
+void init_history_search(void);
+
+// Append entries added since the last save (after each command, on exit)
 void save_history_to_file(void);
 
-// Load history from file on startup
+// Load the newest HISTSIZE entries from the file (and into readline)
 void load_history_from_file(void);
 
+// Forget the in-memory entries (history -c)
+void clear_history_entries(void);
+
 // Cleanup history (free memory)
 void cleanup_history(void);
 
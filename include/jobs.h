@@ -0,0 +1,82 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <sys/types.h>
+#include <termios.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "launcher.h"
+
+typedef enum {
+    PROC_RUNNING,
+    PROC_STOPPED,
+    PROC_DONE
+} proc_state_t;
+
+typedef struct {
+    pid_t pid;              // 0 if it never started
+    int status;             // raw wait status, valid once stopped/done
+    proc_state_t state;
+    struct timespec started;    // launch time (CLOCK_MONOTONIC)
+    double wall;                // seconds from launch to reap, once done
+    struct rusage usage;        // from wait4, once done
+} job_process_t;
+
+// What a finished foreground process left behind (PIPESTATUS, time)
+typedef struct {
+    int status;             // shell exit status
+    double wall;
+    struct rusage usage;
+} job_result_t;
+
+// One pipeline (or backgrounded compound command) = one job = one
+// process group when job control is on
+typedef struct job {
+    int id;                     // %n, 0 while it's a foreground job
+    pid_t pgid;                 // 0 until the first process starts
+    char *command;              // text shown by jobs and notifications
+    job_process_t *procs;
+    int proc_count;
+    int proc_cap;
+    int notify;                 // state changed, report it at the next prompt
+    unsigned long seq;          // last time it was stopped/backgrounded (%+)
+    struct termios tmodes;      // terminal modes saved when it stopped
+    int has_tmodes;
+    struct job *next;
+} job_t;
+
+// Setup. Job control (process groups, terminal, Ctrl+Z) only when
+// interactive; without it jobs are still tracked for jobs/wait/kill.
+void init_job_control(int interactive);
+int job_control_enabled(void);
+int job_signal_fd(void);        // readable after SIGCHLD, -1 if not interactive
+void jobs_enter_child(void);    // in forked shell children: no job control
+
+// Launching
+job_t* job_create(const char *command);
+void job_prepare_launch(const job_t *job, launch_spec_t *spec, int foreground);
+void job_enter_group(const job_t *job, int foreground);    // after fork, in the child
+void job_add_process(job_t *job, pid_t pid);                // in the parent
+void job_add_result(job_t *job, int status);                // stage that failed to start
+void job_process_reaped(job_t *job, pid_t pid, int status,
+                        const struct rusage *usage);   // caller did the wait
+int job_run_foreground(job_t *job);     // wait; returns the job's status (see pipefail)
+int job_last_results(const job_result_t **results);    // per process, last foreground job
+void job_forget_results(void);                          // before running the next command
+void job_run_background(job_t *job);    // hand it to the job table
+void job_discard(job_t *job);           // nothing started, drop it
+
+// Reaping and notification, from the main loop (never in the handler)
+void jobs_poll(void);
+int jobs_have_news(void);
+void jobs_notify(void);
+
+// Builtin support
+job_t* job_find(const char *spec);      // %n, %+, %%, %-, %name or pid
+int job_signal(job_t *job, int sig);
+int job_continue(job_t *job, int foreground);
+int job_wait(job_t *job);
+int jobs_wait_all(void);
+void jobs_print(void);
+
+#endif
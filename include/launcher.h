@@ -0,0 +1,43 @@
+#ifndef LAUNCHER_H
+#define LAUNCHER_H
+
+#include <sys/types.h>
+#include "parsers.h"
+
+// How child processes get created
+typedef enum {
+    LAUNCH_SPAWN,   // posix_spawn (vfork-style clone, no page table copy)
+    LAUNCH_FORK     // classic fork() + exec, used as fallback
+} launch_mode_t;
+
+// Everything needed to start one external command
+typedef struct {
+    char **args;
+    const redirection_t *redirections;
+    int redirect_count;
+    int stdin_fd;           // pipe end to use as stdin, -1 to inherit
+    int stdout_fd;          // pipe end to use as stdout, -1 to inherit
+    const int *close_fds;   // extra fds the child must not keep (other pipe ends)
+    int close_count;
+    int set_pgroup;         // move the child into process group pgid
+    pid_t pgid;             // 0 = start a new group led by the child
+    int take_terminal;      // make the child's group the terminal's foreground
+} launch_spec_t;
+
+// Start the command described by spec
+// Returns child pid, or -1 with errno set if it could not be started
+pid_t launch_process(const launch_spec_t *spec);
+
+// Print why a launch failed (errno) and return the matching exit status
+int report_launch_failure(const char *cmd);
+
+// pipe2(O_CLOEXEC), grown to size bytes with F_SETPIPE_SZ if size > 0
+int open_pipe(int fds[2], int size);
+
+// Apply redirections to the current process (used by builtins and fork path)
+int apply_redirections(const redirection_t *redirections, int count);
+
+void set_launch_mode(launch_mode_t mode);
+launch_mode_t get_launch_mode(void);
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#define PIPE_SIZE_ENV "NUTSHELL_PIPE_SIZE"
+
+// Shell options, changed with `set -o name[=value]` / `set +o name`
+typedef struct {
+    int pipefail;       // a pipeline fails if any stage fails, not just the last
+    int pipe_size;      // bytes per pipeline pipe, 0 = kernel default
+    int timing;         // log every command's time/usage (timing builtin)
+} shell_options_t;
+
+extern shell_options_t shell_options;
+
+// name or name=value. Returns 0, or -1 for an unknown option/bad value
+int set_shell_option(const char *spec, int on);
+
+// `set -o`: every option and its value
+void print_shell_options(void);
+
+// Pipe capacity for pipelines: pipesize if set, else NUTSHELL_PIPE_SIZE
+int shell_pipe_size(void);
+
+#endif
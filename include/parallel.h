@@ -0,0 +1,15 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#define PARALLEL_READ_CHUNK 65536   // bytes read from a task's output at a time
+#define PARALLEL_POLL_MS 10         // exit polling when there's no SIGCHLD self-pipe
+
+// parallel [-j N] [-k | -u] [-f] command [args] [::: input ...]
+// Runs command once per input (from ::: or stdin lines), {} in an argument
+// replaced by the input or the input appended. At most N at once (default:
+// online CPUs). Output is grouped per task, in input order with -k, or
+// passed through with -u. -f stops at the first failure and terminates the
+// rest. Statuses land in PARALLEL_STATUS; returns the first failure's.
+int builtin_parallel(char **args);
+
+#endif
@@ -1,19 +1,21 @@
 #ifndef PARSERS_H
 #define PARSERS_H
 
-#define MAX_ARGS 128
-#define MAX_COMMANDS 64
-#define MAX_REDIRECTIONS 8
+#include <stddef.h>
+#include "arena.h"
+
+#define PARSE_CACHE_SIZE 128        // parsed lines kept for reuse (LRU)
+#define PARSE_CACHE_BUCKETS 256
 
 typedef enum {
-   
+
     REDIRECT_NONE,
     REDIRECT_OUTPUT,        // >
     REDIRECT_APPEND,        // >>
     REDIRECT_INPUT,         // <
     REDIRECT_ERROR,         // 2>
     REDIRECT_BOTH ,         // &>
-   
+
 } redirect_type_t;  // for Redirection i/o
 
 
@@ -23,40 +25,81 @@ typedef struct {
     int fd;  // File descriptor number (for 2>, 3>, etc.)
 } redirection_t;
 
-typedef enum {
-    EXEC_NORMAL,
-    EXEC_AND,     // Execute only if previous succeeded (&&)
-    EXEC_OR       // Execute only if previous failed (||)
-} exec_condition_t;
+// =================================================================
+// AST - what the parser produces and the cache keeps
+// =================================================================
 
-// Add this enum after your existing enums
 typedef enum {
-    OP_NONE,        // No operator
-    OP_SEMICOLON,   // ;
-    OP_AND,         // &&
-    OP_OR,          // ||
-    OP_PIPE,        // |
-    OP_BACKGROUND   // &
-} operator_type_t;
+    NODE_COMMAND,    // simple command: words + redirections
+    NODE_PIPELINE,   // a | b | c
+    NODE_AND,        // a && b
+    NODE_OR,         // a || b
+    NODE_LIST,       // a ; b & c
+    NODE_SUBSHELL    // ( list )
+} node_type_t;
 
+// Word flags, decided once at parse time
+#define WORD_EXPAND  0x1    // contains @var outside single quotes
+#define WORD_QUOTED  0x2    // had quotes, so it's never split after expansion
 
 typedef struct {
-    char *args[MAX_ARGS];
-    int is_background;
-    redirection_t redirections[MAX_REDIRECTIONS];
+    char *text;     // literal (quotes removed) if !WORD_EXPAND, else raw text
+    int flags;
+} word_t;
+
+typedef struct {
+    redirect_type_t type;
+    word_t target;
+} redir_node_t;
+
+typedef struct ast_node {
+    node_type_t type;
+    int count;                      // words (COMMAND) or children (others)
+    int redirect_count;             // COMMAND, SUBSHELL
+    int background;                 // ends with & inside its list
+    int timed;                      // `time` prefix (PIPELINE, or a lone COMMAND/SUBSHELL)
+    word_t *words;                  // COMMAND
+    redir_node_t *redirections;     // COMMAND, SUBSHELL
+    struct ast_node **children;     // PIPELINE stages, LIST items,
+                                    // AND/OR [left, right], SUBSHELL [body]
+} ast_node_t;
+
+// A parsed input line, owned by the parse cache
+typedef struct parsed_line {
+    char *source;                   // copy of the raw line (cache key)
+    size_t hash;
+    ast_node_t *ast;                // NULL for blank lines
+    arena_t arena;                  // owns source, nodes and words
+    int refs;                       // in use by the executor, don't evict
+    struct parsed_line *lru_prev;
+    struct parsed_line *lru_next;
+    struct parsed_line *bucket_next;
+} parsed_line_t;
+
+// =================================================================
+// Expanded command - what the executor runs
+// =================================================================
+
+typedef struct {
+    char **args;                    // NULL-terminated, lives in the line arena
+    int argc;
+    redirection_t *redirections;
     int redirect_count;
-    exec_condition_t condition; 
-    operator_type_t next_operator;  
+    int is_background;
+    const ast_node_t *subshell;     // ( list ) stage: run body in a forked child
 } command_t;
 
+// Parse a raw line, or fetch it from the cache. NULL on syntax error.
+// The result is pinned until release_command_line().
+parsed_line_t* parse_command_line(const char *input);
+void release_command_line(parsed_line_t *line);
 
-typedef struct {
-    command_t commands[MAX_COMMANDS];
-    int count;
-    int is_pipeline;
-} command_list_t;
+// Expansion pass: turn a COMMAND/SUBSHELL node into argv + redirections
+// using the current variable values. Allocations go to the line arena.
+int expand_command(const ast_node_t *node, command_t *cmd, arena_t *arena);
 
-void parse_command_line(char *input, command_list_t *cmd_list);
-void free_command_list(command_list_t *cmd_list);
+// Cache maintenance
+void clear_parse_cache(void);
+void parse_cache_stats(unsigned long *hits, unsigned long *misses);
 
 #endif
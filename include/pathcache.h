@@ -0,0 +1,37 @@
+#ifndef PATHCACHE_H
+#define PATHCACHE_H
+
+#define PATH_CACHE_SIZE 64
+
+typedef struct path_entry {
+    char *name;             // command name as typed
+    char *path;             // absolute path it resolved to
+    unsigned long hits;     // lookups served from the cache
+    struct path_entry *next;
+} path_entry_t;
+
+// Resolve a command name to an executable path (bash-style `hash`)
+// Names containing '/' are returned as-is. NULL if not found in PATH.
+const char* path_cache_lookup(const char *name);
+
+// `hash -p path name`: remember name as path without searching
+int path_cache_insert(const char *name, const char *path);
+
+// `hash name`: forget name and search PATH for it again
+int path_cache_rehash(const char *name);
+
+// Called after exec of a cached path failed: one stat to check the entry,
+// re-resolve through PATH if it went stale. Returns the (possibly same)
+// path, or NULL if the command is gone. Old path pointers are invalid after.
+const char* path_cache_revalidate(const char *name);
+
+// Drop everything (PATH changed, or `hash -r`)
+void path_cache_clear(void);
+
+// Print table; reusable = 1 prints `hash -p` lines (`hash -l`)
+void path_cache_print(int reusable);
+
+// Hit/miss counters since startup
+void path_cache_stats(unsigned long *hits, unsigned long *misses);
+
+#endif
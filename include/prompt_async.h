@@ -0,0 +1,37 @@
+#ifndef PROMPT_ASYNC_H
+#define PROMPT_ASYNC_H
+
+#define ASYNC_DEADLINE_MS 30        // how long a prompt waits for a fresh value
+#define ASYNC_TIMEOUT_MS 2000       // a provider still running after this is killed
+#define ASYNC_CACHE_SIZE 32         // (provider, directory) values remembered
+#define ASYNC_VALUE_MAX 128
+#define ASYNC_PLACEHOLDER "..."     // shown until a directory's first value arrives
+
+// Prompt segments too slow to compute while the user waits for a prompt.
+// A worker thread computes them per directory; the prompt shows the cached
+// value (even a stale one) or a placeholder, and is redrawn when the fresh
+// value arrives.
+typedef enum {
+    ASYNC_GIT,          // branch, with * when the work tree is dirty
+    ASYNC_PROVIDER_COUNT
+} async_provider_t;
+
+void async_segments_init(void);     // start the worker (interactive shells)
+
+// Value of provider for dir. A stale value is returned at once and
+// refreshed by the worker; a missing one is waited for up to
+// ASYNC_DEADLINE_MS, then ASYNC_PLACEHOLDER.
+const char* async_segment_get(async_provider_t provider, const char *dir);
+
+// A command ran: every cached value may be out of date now
+void async_segments_invalidate(void);
+
+// Readable when the worker finished something after the deadline.
+// async_segments_drain() empties it and returns 1 if a prompt would change.
+int async_segments_fd(void);
+int async_segments_drain(void);
+
+// Bumped whenever a value arrives, so the prompt knows to re-render
+unsigned long async_segments_gen(void);
+
+#endif
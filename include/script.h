@@ -0,0 +1,19 @@
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+// Runs one input line, returns its exit status
+typedef int (*line_handler_t)(char *line);
+
+// Non-interactive input sources (no readline, prompt or history)
+// All return the exit status of the last command executed
+
+// nutshell -c "cmd"
+int run_script_string(const char *text, line_handler_t handler);
+
+// nutshell file.nsh (mmap'd)
+int run_script_file(const char *path, line_handler_t handler);
+
+// cmd | nutshell (read in large blocks)
+int run_script_fd(int fd, line_handler_t handler);
+
+#endif
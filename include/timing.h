@@ -0,0 +1,37 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include "jobs.h"
+
+#define TIMING_LOG_SIZE 128         // commands kept by `set -o timing`
+#define TIMING_TEXT_MAX 128         // command text kept per record
+#define TIMEFORMAT_DEFAULT "\nreal\t%3lR\nuser\t%3lU\nsys\t%3lS"
+
+// One command (pipeline or simple command) as measured by the executor
+typedef struct {
+    char command[TIMING_TEXT_MAX];
+    int status;
+    int stages;
+    double wall;            // whole command, seconds
+    double user;            // every stage plus the shell itself
+    double sys;
+    long max_rss_kb;        // largest stage
+    long voluntary_csw;     // summed over stages
+    long involuntary_csw;
+} timing_record_t;
+
+// Fill rec's totals from the stages of the job that just ran and the
+// shell's own usage while it ran (builtins run in the shell)
+void timing_summarize(timing_record_t *rec, const job_result_t *stages, int count,
+                      const struct rusage *self_before, const struct rusage *self_after);
+
+// `time`: TIMEFORMAT summary, then one line per stage, on stderr
+void timing_report(const timing_record_t *rec, const job_result_t *stages, int count,
+                   const char *const *labels);
+
+// `set -o timing` ring, queried with the timing builtin
+void timing_log(const timing_record_t *rec);
+void timing_print(int count);       // newest count records, 0 = all
+void timing_clear(void);
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef TOKENIZER_H
+#define TOKENIZER_H
+
+#include <stddef.h>
+
+#define TOKEN_INLINE 64     // tokens stored without malloc (typical lines)
+
+typedef enum
+{
+    TOKEN_WORD,
+    TOKEN_PIPE,            // |
+    TOKEN_BACKGROUND,      // &
+    TOKEN_SEMICOLON,       // ;
+    TOKEN_REDIRECT_OUT,    // >
+    TOKEN_REDIRECT_APPEND, // >>
+    TOKEN_REDIRECT_IN,     // <
+    TOKEN_REDIRECT_ERR,    // 2>
+    TOKEN_REDIRECT_BOTH,   // &>
+    TOKEN_AND,             // &&
+    TOKEN_OR,              // ||
+    TOKEN_LPAREN,          // (
+    TOKEN_RPAREN,          // )
+    TOKEN_EOF
+} token_type_t;
+
+// Tokens are slices of the input line, nothing is copied
+typedef struct
+{
+    token_type_t type;
+    const char *start;
+    size_t len;
+} token_t;
+
+// Growable token array owned by the caller (so tokenize is reentrant)
+typedef struct
+{
+    token_t *tokens;
+    int count;
+    int cap;
+    token_t inline_tokens[TOKEN_INLINE];
+} token_buf_t;
+
+// Which scanner classifies the bytes
+typedef enum
+{
+    TOKENIZER_AUTO,     // best the CPU supports
+    TOKENIZER_SCALAR,   // byte at a time
+    TOKENIZER_SSE2,     // 16 bytes at a time
+    TOKENIZER_AVX2      // 32 bytes at a time
+} tokenizer_backend_t;
+
+void token_buf_init(token_buf_t *buf);
+void token_buf_free(token_buf_t *buf);
+
+// Split input into tokens, always terminated by a TOKEN_EOF token
+// Returns 0, or -1 if out of memory
+int tokenize(const char *input, token_buf_t *buf);
+
+// Returns -1 if the backend isn't available on this CPU/build
+int set_tokenizer_backend(tokenizer_backend_t backend);
+const char* tokenizer_backend_name(void);
+
+#endif
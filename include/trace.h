@@ -0,0 +1,35 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#define TRACE_RING_SIZE 65536       // spans kept, oldest overwritten (power of two)
+#define TRACE_DETAIL_MAX 48         // command name / text kept per span
+
+// Where a command line's time goes: expand, tokenize, parse, spawn, fork,
+// wait. Spans are recorded only between `trace start` and `trace stop`;
+// otherwise TRACE_BEGIN is one load and a branch. Forked children
+// (pipeline builtins, subshells, background lists) record into their own
+// copy of the ring, so their spans are lost; the parent's fork and wait
+// spans still cover them.
+extern int trace_enabled;
+
+uint64_t trace_now_ns(void);        // CLOCK_MONOTONIC
+
+// start is 0 when tracing was off at TRACE_BEGIN: nothing is recorded
+void trace_record(const char *name, const char *detail, uint64_t start);
+
+#define TRACE_BEGIN() (trace_enabled ? trace_now_ns() : 0)
+#define TRACE_END(start, name, detail) \
+    do { if (start) trace_record((name), (detail), (start)); } while (0)
+
+void trace_start(void);             // clears the ring
+void trace_stop(void);
+
+// Chrome trace-event JSON (chrome://tracing, Perfetto). 0, or -1 with errno.
+int trace_dump(const char *path);
+
+// Spans recorded since trace start, and how many of them the ring lost
+void trace_stats(unsigned long *recorded, unsigned long *overwritten);
+
+#endif
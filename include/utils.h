@@ -1,10 +1,16 @@
 #ifndef UTILS_H
 #define UTILS_H
 
-// Prompt generation functions
-char* get_simple_prompt(void);
-char* get_fancy_prompt(void);       // shorten dir struct
-char* get_full_prompt(void);      // with username
-char* get_colored_prompt(void); // for coloured shell 
+#define PROMPT_MAX 1024
+#define PROMPT_SEGMENTS_MAX 64
+#define DEFAULT_PROMPT "\\[\\e[32m\\]nutshell\\[\\e[0m\\]:\\[\\e[34m\\]\\w\\[\\e[0m\\]> "
+
+// Prompt from the PROMPT variable (PS1-style: \u \h \H \w \W \$ \n \e
+// \[ \], plus \? status, \d duration, \g git), or DEFAULT_PROMPT.
+// Cached: re-rendered only when something it shows changed.
+void init_prompt(void);             // cache user, host and cwd
+void prompt_cwd_changed(void);      // after chdir (cdir)
+void prompt_command_finished(double seconds);   // after each command line
+const char* render_prompt(void);
 
 #endif
@@ -1,19 +1,38 @@
 #ifndef VARIABLES_H
 #define VARIABLES_H
 
+#include "arena.h"
+
 #define MAX_VAR_NAME 256
 #define MAX_VAR_VALUE 1024
-#define HASH_TABLE_SIZE 128
+#define VAR_INLINE_NAME 24       // names shorter than this live in the entry
+#define VAR_TABLE_MIN_SLOTS 64
 
-typedef struct variable {
-    char *name;
-    char *value;
-    int is_exported;  // Whether it's an environment variable
-    struct variable *next;  // For hash table collision chaining
+// Variables are kept in a dense array in insertion order (what set/export
+// list), indexed by an open-addressing Robin Hood table of slots.
+typedef struct {
+    union {
+        char inline_name[VAR_INLINE_NAME];
+        char *heap_name;
+    } name;
+    char *value;            // NULL once unset (tombstone until compaction)
+    unsigned int hash;      // full hash, never recomputed
+    unsigned int name_len;
+    int is_exported;        // Whether it's an environment variable
 } variable_t;
 
 typedef struct {
-    variable_t *buckets[HASH_TABLE_SIZE];
+    unsigned int hash;      // 0 = empty slot
+    unsigned int entry;     // index into entries
+} var_slot_t;
+
+typedef struct {
+    var_slot_t *slots;
+    size_t slot_cap;        // power of two
+    size_t live;            // occupied slots
+    variable_t *entries;
+    size_t entry_count;     // including tombstones
+    size_t entry_cap;
 } var_table_t;
 
 // Variable management functions
@@ -22,10 +41,23 @@ void cleanup_variables(void);
 int set_variable(const char *name, const char *value, int export_flag);
 char* get_variable(const char *name);
 int unset_variable(const char *name);
-void list_variables(void);
+void list_variables(int exported_only);
+
+// envp for spawned programs: exported vars only, rebuilt only when an
+// export changed since the last call. Owned by the table, don't free.
+char** get_environment(void);
+
+// @? : status of the last command
+void set_last_status(int status);
+int get_last_status(void);
+
+// Assignments (NAME=value)
+int is_assignment(const char *str);
+int assign_variable(const char *assignment);
 
 // Variable expansion
-char* expand_variables(const char *input);
+char* expand_variables(const char *input);                        // caller frees
+char* expand_variables_arena(const char *input, arena_t *arena);  // freed with the arena
 
 
 
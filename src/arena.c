@@ -0,0 +1,87 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdalign.h>
+#include "arena.h"
+#include "debug.h"
+
+#define ARENA_ALIGN alignof(max_align_t)
+
+static size_t align_up(size_t n) {
+    return (n + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+}
+
+static arena_block_t* new_block(size_t min_size) {
+    size_t size = min_size > ARENA_BLOCK_SIZE ? min_size : ARENA_BLOCK_SIZE;
+    arena_block_t *block = malloc(sizeof(arena_block_t) + size);
+    if (!block) return NULL;
+
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+void arena_init(arena_t *arena) {
+    arena->first = NULL;
+    arena->current = NULL;
+}
+
+void* arena_alloc(arena_t *arena, size_t size) {
+    size = align_up(size ? size : 1);
+
+    arena_block_t *block = arena->current;
+    if (block && block->size - block->used >= size) {
+        void *ptr = block->data + block->used;
+        block->used += size;
+        return ptr;
+    }
+
+    // Out of room: chain a new block (oversized requests get their own)
+    arena_block_t *fresh = new_block(size);
+    if (!fresh) {
+        DEBUG_ERROR("arena: out of memory allocating %zu bytes", size);
+        return NULL;
+    }
+
+    if (block) {
+        block->next = fresh;
+    } else {
+        arena->first = fresh;
+    }
+    arena->current = fresh;
+
+    fresh->used = size;
+    return fresh->data;
+}
+
+char* arena_strndup(arena_t *arena, const char *str, size_t len) {
+    char *copy = arena_alloc(arena, len + 1);
+    if (!copy) return NULL;
+
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+void arena_reset(arena_t *arena) {
+    if (!arena->first) return;
+
+    // Overflow blocks only exist for unusually long lines
+    arena_block_t *block = arena->first->next;
+    while (block) {
+        arena_block_t *next = block->next;
+        free(block);
+        block = next;
+    }
+
+    arena->first->next = NULL;
+    arena->first->used = 0;
+    arena->current = arena->first;
+}
+
+void arena_destroy(arena_t *arena) {
+    arena_reset(arena);
+    free(arena->first);
+    arena->first = NULL;
+    arena->current = NULL;
+}
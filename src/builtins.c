@@ -1,3 +1,4 @@
+#define _GNU_SOURCE     // splice
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -7,197 +8,615 @@
 #include "history.h"
 #include "variables.h"
 #include "debug.h"
+#include "pathcache.h"
+#include "jobs.h"
+#include "options.h"
+#include "timing.h"
+#include "trace.h"
+#include "parallel.h"
+#include "utils.h"
+#include "builtin_hash.h"     // generated from builtin_table.h
+#include <signal.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
 
-int handle_builtin(char **args)
-{
-   
-    if (args[0] == NULL)
-        return 0;
+#define FCAT_CHUNK (1 << 20)        // bytes per splice/sendfile call
+#define FCAT_BUFFER (64 * 1024)     // read/write fallback buffer
 
-    if (strcmp(args[0], "exit") == 0)
-        exit(0);
+// Plain read/write copy, for when the kernel can't move the data itself
+static int copy_by_buffer(int in, int out)
+{
+    char buf[FCAT_BUFFER];
+    ssize_t n;
 
-    if (strcmp(args[0], "cdir") == 0)
+    while ((n = read(in, buf, sizeof(buf))) != 0)
     {
-        if (args[1] == NULL)
+        if (n < 0)
         {
-            DEBUG_WARN( "cd: missing argument\n");
+            if (errno == EINTR) continue;
+            return -1;
         }
-        else if (chdir(args[1]) != 0)
+        for (ssize_t done = 0; done < n;)
         {
-            DEBUG_ERROR("cd failed: %s", strerror(errno));
+            ssize_t w = write(out, buf + done, n - done);
+            if (w < 0)
+            {
+                if (errno == EINTR) continue;
+                return -1;
+            }
+            done += w;
+        }
+    }
+    return 0;
+}
+
+// Copy in to out without bringing the data into user space: splice when
+// out is a pipe, sendfile from regular files otherwise, buffer as last resort
+static int copy_fd(int in, int out)
+{
+    struct stat out_st, in_st;
+    int out_is_pipe = fstat(out, &out_st) == 0 && S_ISFIFO(out_st.st_mode);
+    int in_is_file = fstat(in, &in_st) == 0 && S_ISREG(in_st.st_mode);
+    ssize_t n;
+
+    if (out_is_pipe)
+    {
+        while ((n = splice(in, NULL, out, NULL, FCAT_CHUNK, SPLICE_F_MOVE | SPLICE_F_MORE)) > 0)
+            ;
+        if (n == 0) return 0;
+        if (errno != EINVAL && errno != ENOSYS) return -1;
+    }
+    else if (in_is_file)
+    {
+        while ((n = sendfile(out, in, NULL, FCAT_CHUNK)) > 0)
+            ;
+        if (n == 0) return 0;
+        if (errno != EINVAL && errno != ENOSYS) return -1;
+    }
+
+    // Nothing was moved yet when splice/sendfile refuse an fd pair
+    return copy_by_buffer(in, out);
+}
+
+// fcat [file...]: cat without options, zero-copy into pipes
+static int builtin_fcat(char **args)
+{
+    int status = 0;
+    fflush(stdout);  // anything printf'd so far goes first
 
+    if (args[1] == NULL)
+    {
+        if (copy_fd(STDIN_FILENO, STDOUT_FILENO) == -1)
+        {
+            if (errno != EPIPE)
+                fprintf(stderr, "fcat: %s\n", strerror(errno));
+            return 1;
         }
-        return 1;
+        return 0;
     }
 
-    if (strcmp(args[0], "history") == 0)
+    for (int i = 1; args[i]; i++)
     {
-        if (args[1] && strcmp(args[1], "-c") == 0)
+        int fd = strcmp(args[i], "-") == 0 ? STDIN_FILENO : open(args[i], O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
         {
-            // history -c to clear history
-            cleanup_history();
-            init_history();
-            printf("History cleared\n");
+            fprintf(stderr, "fcat: %s: %s\n", args[i], strerror(errno));
+            status = 1;
+            continue;
         }
-        else if (args[1] && strcmp(args[1], "-w") == 0)
+
+        int failed = copy_fd(fd, STDOUT_FILENO) == -1;
+        int err = errno;
+        if (failed)
         {
-            // Write/save history immediately
-            save_history_to_file();
+            status = 1;
+            if (err != EPIPE)
+                fprintf(stderr, "fcat: %s: %s\n", args[i], strerror(err));
         }
-        else
+
+        if (fd != STDIN_FILENO)
+            close(fd);
+        if (failed && err == EPIPE)
+            break;  // reader went away
+    }
+    return status;
+}
+
+// Signal names kill understands (with or without the SIG prefix)
+static const struct
+{
+    const char *name;
+    int number;
+} signal_names[] = {
+    {"HUP", SIGHUP}, {"INT", SIGINT}, {"QUIT", SIGQUIT}, {"KILL", SIGKILL},
+    {"USR1", SIGUSR1}, {"USR2", SIGUSR2}, {"PIPE", SIGPIPE}, {"ALRM", SIGALRM},
+    {"TERM", SIGTERM}, {"CHLD", SIGCHLD}, {"CONT", SIGCONT}, {"STOP", SIGSTOP},
+    {"TSTP", SIGTSTP}, {"TTIN", SIGTTIN}, {"TTOU", SIGTTOU}, {NULL, 0}
+};
+
+static int parse_signal(const char *text)
+{
+    if (isdigit((unsigned char)text[0]))
+    {
+        return atoi(text);
+    }
+    if (strncmp(text, "SIG", 3) == 0)
+    {
+        text += 3;
+    }
+    for (int i = 0; signal_names[i].name; i++)
+    {
+        if (strcmp(text, signal_names[i].name) == 0)
         {
-            // Show history
-            print_history();
+            return signal_names[i].number;
         }
+    }
+    return -1;
+}
+
+static int builtin_jobs(char **args)
+{
+    (void)args;
+    jobs_print();
+    return 0;
+}
+
+// fg / bg [%job]
+static int resume_job(char **args, int foreground)
+{
+    if (!job_control_enabled())
+    {
+        fprintf(stderr, "%s: no job control\n", args[0]);
         return 1;
     }
 
-    if (strcmp(args[0], "clearscreen") == 0)
+    job_t *job = job_find(args[1]);
+    if (!job)
     {
-        system("clear");
+        fprintf(stderr, "%s: %s: no such job\n", args[0], args[1] ? args[1] : "current");
         return 1;
     }
+    return job_continue(job, foreground);
+}
+
+static int builtin_fg(char **args)
+{
+    return resume_job(args, 1);
+}
 
-    if (strcmp(args[0], "pcd") == 0)
+static int builtin_bg(char **args)
+{
+    return resume_job(args, 0);
+}
+
+// wait [%job|pid ...]: status of the last one waited for
+static int builtin_wait(char **args)
+{
+    int status = 0;
+
+    if (args[1] == NULL)
+        return jobs_wait_all();
+
+    for (int i = 1; args[i]; i++)
     {
-        char cwd[1024];
-        if (getcwd(cwd, sizeof(cwd)))
-        {
-            printf("%s\n", cwd);
-        }
-        else
+        job_t *job = job_find(args[i]);
+        if (!job)
         {
-            DEBUG_ERROR("pcd failed: %s", strerror(errno));
+            fprintf(stderr, "wait: %s: no such job\n", args[i]);
+            status = 127;
+            continue;
         }
+        status = job_wait(job);
+    }
+    return status;
+}
+
+// kill [-N | -NAME | -s NAME] %job|pid ...
+static int builtin_kill(char **args)
+{
+    int sig = SIGTERM;
+    int status = 0;
+    int i = 1;
+
+    // kill -9, kill -KILL, kill -s KILL
+    if (args[i] && strcmp(args[i], "-s") == 0 && args[i + 1])
+    {
+        sig = parse_signal(args[i + 1]);
+        i += 2;
+    }
+    else if (args[i] && args[i][0] == '-' && args[i][1])
+    {
+        sig = parse_signal(args[i] + 1);
+        i++;
+    }
+
+    if (sig < 0)
+    {
+        fprintf(stderr, "kill: invalid signal\n");
+        return 1;
+    }
+    if (args[i] == NULL)
+    {
+        fprintf(stderr, "Usage: kill [-SIGNAL] %%job|pid ...\n");
         return 1;
     }
 
-    if (strcmp(args[0], "export") == 0)
+    for (; args[i]; i++)
     {
-        if (args[1] == NULL)
-        {
-            // List all exported variables
-            list_variables();
-        }
-        else
+        if (args[i][0] == '%')
         {
-            // Parse VAR=VALUE or just VAR
-            char *equals = strchr(args[1], '=');
-            if (equals)
+            job_t *job = job_find(args[i]);
+            if (!job)
             {
-                *equals = '\0'; // Split name and value
-                char *name = args[1];
-                char *value = equals + 1;
-
-                // Expand variables in the value
-                char *expanded_value = expand_variables(value);
-                set_variable(name, expanded_value, 1); // 1 = export
-                free(expanded_value);
-
-                printf("Exported %s=%s\n", name, get_variable(name));
+                fprintf(stderr, "kill: %s: no such job\n", args[i]);
+                status = 1;
             }
-            else
+            else if (job_signal(job, sig) == -1)
             {
-                // Export existing variable
-                char *value = get_variable(args[1]);
-                if (value)
-                {
-                    set_variable(args[1], value, 1);
-                    printf("Exported %s\n", args[1]);
-                }
-                else
-                {
-                    DEBUG_ERROR("Variable %s not found\n", args[1]);
-                }
+                fprintf(stderr, "kill: %s: %s\n", args[i], strerror(errno));
+                status = 1;
             }
         }
+        else if (kill((pid_t)atoi(args[i]), sig) == -1)
+        {
+            fprintf(stderr, "kill: %s: %s\n", args[i], strerror(errno));
+            status = 1;
+        }
+    }
+    return status;
+}
+
+static int builtin_exit(char **args)
+{
+    exit(args[1] ? atoi(args[1]) : get_last_status());
+}
+
+static int builtin_cdir(char **args)
+{
+    if (args[1] == NULL)
+    {
+        DEBUG_WARN( "cd: missing argument\n");
+        return 1;
+    }
+    if (chdir(args[1]) != 0)
+    {
+        DEBUG_ERROR("cd failed: %s", strerror(errno));
         return 1;
     }
+    prompt_cwd_changed();
+    return 0;
+}
 
-    if (strcmp(args[0], "set") == 0)
+static int builtin_history(char **args)
+{
+    if (args[1] && strcmp(args[1], "-c") == 0)
+    {
+        // history -c to clear history
+        save_history_to_file();
+        clear_history_entries();
+        printf("History cleared\n");
+    }
+    else if (args[1] && strcmp(args[1], "-w") == 0)
     {
-        if (args[1] == NULL)
+        // Write/save history immediately
+        save_history_to_file();
+    }
+    else if (args[1] && strcmp(args[1], "-s") == 0)
+    {
+        // history -s pattern: ranked search
+        if (args[2] == NULL)
         {
-            list_variables();
+            printf("Usage: history -s pattern\n");
+            return 1;
         }
-        else
-        {
-            char *equals = strchr(args[1], '=');
-            if (equals)
-            {
-                *equals = '\0';
-                char *name = args[1];
-                char *value = equals + 1;
+        print_history_matches(args[2]);
+    }
+    else
+    {
+        // Show history
+        print_history();
+    }
+    return 0;
+}
 
-                char *expanded_value = expand_variables(value);
-                set_variable(name, expanded_value, 0); // 0 = not exported
-                free(expanded_value);
+static int builtin_hash(char **args)
+{
+    int status = 0;
 
-                DEBUG_INFO("Set %s=%s\n", name, get_variable(name));
-            }
-            else
+    if (args[1] == NULL)
+    {
+        path_cache_print(0);
+    }
+    else if (strcmp(args[1], "-r") == 0)
+    {
+        // Forget all remembered locations
+        path_cache_clear();
+    }
+    else if (strcmp(args[1], "-l") == 0)
+    {
+        // Print in a form that can be reused as input
+        path_cache_print(1);
+    }
+    else if (strcmp(args[1], "-p") == 0)
+    {
+        if (args[2] && args[3])
+        {
+            path_cache_insert(args[3], args[2]);
+        }
+        else
+        {
+            printf("Usage: hash -p path name\n");
+            status = 1;
+        }
+    }
+    else if (strcmp(args[1], "-s") == 0)
+    {
+        unsigned long hits, misses;
+        path_cache_stats(&hits, &misses);
+        printf("hits: %lu, misses: %lu\n", hits, misses);
+    }
+    else
+    {
+        for (int i = 1; args[i]; i++)
+        {
+            if (path_cache_rehash(args[i]) != 0)
             {
-                DEBUG_INFO("Usage: set VAR=VALUE\n");
+                printf("hash: %s: not found\n", args[i]);
+                status = 1;
             }
         }
+    }
+    return status;
+}
+
+static int builtin_clearscreen(char **args)
+{
+    (void)args;
+    return system("clear") == 0 ? 0 : 1;
+}
+
+static int builtin_pcd(char **args)
+{
+    char cwd[1024];
+    (void)args;
+    if (getcwd(cwd, sizeof(cwd)) == NULL)
+    {
+        DEBUG_ERROR("pcd failed: %s", strerror(errno));
+        return 1;
+    }
+    printf("%s\n", cwd);
+    return 0;
+}
+
+static int builtin_export(char **args)
+{
+    if (args[1] == NULL)
+    {
+        // List all exported variables
+        list_variables(1);
+        return 0;
+    }
+
+    // Parse VAR=VALUE or just VAR
+    char *equals = strchr(args[1], '=');
+    if (equals)
+    {
+        *equals = '\0'; // Split name and value
+        char *name = args[1];
+        char *value = equals + 1;
+
+        // Already expanded (and unquoted) by expand_command
+        set_variable(name, value, 1); // 1 = export
+
+        printf("Exported %s=%s\n", name, get_variable(name));
+        return 0;
+    }
+
+    // Export existing variable
+    char *value = get_variable(args[1]);
+    if (!value)
+    {
+        DEBUG_ERROR("Variable %s not found\n", args[1]);
         return 1;
     }
+    set_variable(args[1], value, 1);
+    printf("Exported %s\n", args[1]);
+    return 0;
+}
+
+static int builtin_set(char **args)
+{
+    if (args[1] == NULL)
+    {
+        list_variables(0);
+        return 0;
+    }
 
-    if (strcmp(args[0], "unset") == 0)
+    // set -o / set -o name / set +o name
+    if (strcmp(args[1], "-o") == 0 || strcmp(args[1], "+o") == 0)
     {
-        if (args[1] == NULL)
+        if (args[2] == NULL)
         {
-            printf("Usage: unset VAR\n");
+            print_shell_options();
+            return 0;
         }
-        else
+        if (set_shell_option(args[2], args[1][0] == '-') != 0)
         {
-            if (unset_variable(args[1]) == 0)
-            {
-                printf("Unset %s\n", args[1]);
-            }
-            else
-            {
-                DEBUG_WARN("Variable %s not found\n", args[1]);
-            }
+            fprintf(stderr, "set: %s: invalid option\n", args[2]);
+            return 1;
         }
+        return 0;
+    }
+
+    char *equals = strchr(args[1], '=');
+    if (!equals)
+    {
+        DEBUG_INFO("Usage: set VAR=VALUE | set -o|+o option\n");
         return 1;
     }
 
-    if (strcmp(args[0], "env") == 0) {
-    DEBUG_VERBOSE(" env command called\n");
-    
-    extern char **environ;
-    DEBUG_VERBOSE("environ pointer: %p\n", (void*)environ);
-    
-    if (environ == NULL) {
-        DEBUG_ERROR("environ is NULL!\n");
+    *equals = '\0';
+    char *name = args[1];
+    char *value = equals + 1;
+
+    set_variable(name, value, 0); // 0 = not exported
+
+    DEBUG_INFO("Set %s=%s\n", name, get_variable(name));
+    return 0;
+}
+
+static int builtin_unset(char **args)
+{
+    if (args[1] == NULL)
+    {
+        printf("Usage: unset VAR\n");
         return 1;
     }
-    
-    if (environ[0] == NULL) {
-        DEBUG_ERROR("environ[0] is NULL - empty environment!\n");
+    if (unset_variable(args[1]) != 0)
+    {
+        DEBUG_WARN("Variable %s not found\n", args[1]);
         return 1;
     }
-    
-    DEBUG_VERBOSE(" About to print environment...\n");
-    
+    printf("Unset %s\n", args[1]);
+    return 0;
+}
+
+static int builtin_env(char **args)
+{
+    // Same snapshot spawned programs get
+    char **envp = get_environment();
     int count = 0;
-    for (int i = 0; environ[i]; i++) {
-        printf("%s\n", environ[i]);
-        count++;
-        
-        if (count > 200) {  // Safety break
-            DEBUG_WARN(" Stopped at 200 vars for safety\n");
-            break;
-        }
+    (void)args;
+    for (; envp && envp[count]; count++)
+    {
+        printf("%s\n", envp[count]);
     }
-    
+
     DEBUG_VERBOSE("Printed %d environment variables\n", count);
-    DEBUG_VERBOSE("env command completed\n");
-    return 1;
+    return 0;
 }
 
+// debug [level] [-o file|-]: show or change the runtime debug level and
+// where messages go (a file, or - for stderr)
+static int builtin_debug(char **args)
+{
+    int i = 1;
+    for (; args[i] && strcmp(args[i], "-o") == 0; i += 2)
+    {
+        if (args[i + 1] == NULL)
+        {
+            fprintf(stderr, "debug: -o needs a file (or - for stderr)\n");
+            return 1;
+        }
+        if (debug_set_output(args[i + 1]) != 0)
+        {
+            fprintf(stderr, "debug: %s: %s\n", args[i + 1], strerror(errno));
+            return 1;
+        }
+    }
+
+    if (args[i] == NULL)
+    {
+        printf("Debug level: %d (%s)\n", g_debug_level, debug_level_to_string(g_debug_level));
+        printf("Debug output: %s\n", debug_output_name());
+        return 0;
+    }
+
+    char *end;
+    long level = strtol(args[i], &end, 10);
+    if (*end != '\0' || end == args[i] || level < DEBUG_NONE || level > DEBUG_VERBOSE)
+    {
+        fprintf(stderr, "debug: level must be %d-%d\n", DEBUG_NONE, DEBUG_VERBOSE);
+        return 1;
+    }
+    if (set_debug_level((debug_level_t)level) != (debug_level_t)level)
+    {
+        fprintf(stderr, "debug: levels above %d (%s) are compiled out of this build\n",
+                NUTSHELL_MAX_DEBUG_LEVEL, debug_level_to_string(NUTSHELL_MAX_DEBUG_LEVEL));
+    }
+    printf("Debug level: %d (%s)\n", g_debug_level, debug_level_to_string(g_debug_level));
+    return 0;
+}
 
+// timing [count] | timing -c: what `set -o timing` recorded
+static int builtin_timing(char **args)
+{
+    if (args[1] && strcmp(args[1], "-c") == 0)
+    {
+        timing_clear();
+        return 0;
+    }
+    if (args[1] && atoi(args[1]) <= 0)
+    {
+        printf("Usage: timing [count] | timing -c\n");
+        return 1;
+    }
+    if (!shell_options.timing)
+    {
+        DEBUG_INFO("timing is off, turn it on with set -o timing");
+    }
+    timing_print(args[1] ? atoi(args[1]) : 0);
     return 0;
 }
+
+// trace start|stop|dump FILE: record expand/parse/fork/exec/wait spans
+// and write them as a Chrome trace (chrome://tracing, Perfetto)
+static int builtin_trace(char **args)
+{
+    unsigned long recorded, overwritten;
+
+    if (args[1] == NULL)
+    {
+        trace_stats(&recorded, &overwritten);
+        printf("Tracing: %s, %lu spans (%lu overwritten)\n",
+               trace_enabled ? "on" : "off", recorded, overwritten);
+        return 0;
+    }
+    if (strcmp(args[1], "start") == 0)
+    {
+        trace_start();
+        return 0;
+    }
+    if (strcmp(args[1], "stop") == 0)
+    {
+        trace_stop();
+        return 0;
+    }
+    if (strcmp(args[1], "dump") == 0 && args[2])
+    {
+        if (trace_dump(args[2]) != 0)
+        {
+            fprintf(stderr, "trace: %s: %s\n", args[2], strerror(errno));
+            return 1;
+        }
+        return 0;
+    }
+
+    printf("Usage: trace [start | stop | dump FILE]\n");
+    return 1;
+}
+
+#define BUILTIN_ENTRY(name, fn, flags) { name, fn, flags },
+static const builtin_t builtins[] = { BUILTIN_LIST(BUILTIN_ENTRY) };
+
+// One hash, one probe, one strcmp
+const builtin_t* find_builtin(const char *name)
+{
+    if (!name)
+        return NULL;
+
+    unsigned int slot = builtin_name_hash(name, BUILTIN_HASH_SEED) & ((1u << BUILTIN_HASH_BITS) - 1);
+    int index = builtin_slot_index[slot];
+    if (index < 0 || strcmp(builtins[index].name, name) != 0)
+        return NULL;
+    return &builtins[index];
+}
+
+int run_builtin(const builtin_t *builtin, char **args)
+{
+    int status = builtin->handler(args);
+    fflush(stdout);  // keep builtin output ahead of whatever runs next
+    return status;
+}
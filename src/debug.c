@@ -1,11 +1,133 @@
 #include "debug.h"
 #include <string.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
 
 // Global debug level variable
-debug_level_t g_debug_level = DEBUG_NONE;
+debug_level_t g_debug_level = DEFAULT_DEBUG_LEVEL > NUTSHELL_MAX_DEBUG_LEVEL
+                              ? NUTSHELL_MAX_DEBUG_LEVEL : DEFAULT_DEBUG_LEVEL;
 
-void set_debug_level(debug_level_t level) {
+// The sink: one buffer, one fd, one lock for every thread
+static pthread_mutex_t sink_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t sink_once = PTHREAD_ONCE_INIT;
+static char sink_buf[DEBUG_SINK_BUFFER];
+static size_t sink_len = 0;
+static int sink_fd = STDERR_FILENO;
+static char sink_name[256] = "stderr";
+static pid_t sink_owner = 0;        // anyone else is a forked child
+
+static void write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        buf += n;
+        len -= n;
+    }
+}
+
+// Caller holds sink_lock
+static void flush_locked(void) {
+    if (sink_len == 0) return;
+    write_all(sink_fd, sink_buf, sink_len);
+    sink_len = 0;
+}
+
+// A child must not inherit half a buffer: it would be written twice
+static void before_fork(void) {
+    pthread_mutex_lock(&sink_lock);
+    flush_locked();
+}
+
+static void after_fork(void) {
+    pthread_mutex_unlock(&sink_lock);
+}
+
+static void sink_init(void) {
+    sink_owner = getpid();
+    pthread_atfork(before_fork, after_fork, after_fork);
+    atexit(debug_flush);
+}
+
+void debug_log(debug_level_t level, const char *fmt, ...) {
+    static const char *const prefixes[] = {
+        [DEBUG_ERROR] = "[ERROR] ",
+        [DEBUG_WARN] = "[WARN] ",
+        [DEBUG_INFO] = "[INFO] ",
+        [DEBUG_VERBOSE] = "[DEBUG] ",
+    };
+    char line[1024];
+    va_list ap;
+
+    pthread_once(&sink_once, sink_init);
+
+    size_t len = strlen(prefixes[level]);
+    memcpy(line, prefixes[level], len);
+    va_start(ap, fmt);
+    int n = vsnprintf(line + len, sizeof(line) - len - 1, fmt, ap);
+    va_end(ap);
+    if (n < 0) return;
+    len += (size_t)n < sizeof(line) - len - 1 ? (size_t)n : sizeof(line) - len - 2;
+    line[len++] = '\n';
+
+    pthread_mutex_lock(&sink_lock);
+    if (sink_len + len > sizeof(sink_buf)) {
+        flush_locked();
+    }
+    memcpy(sink_buf + sink_len, line, len);
+    sink_len += len;
+    // Errors and warnings are for whoever is looking now; a forked child
+    // may exec or _exit any moment, so it doesn't buffer at all
+    if (level <= DEBUG_WARN || getpid() != sink_owner) {
+        flush_locked();
+    }
+    pthread_mutex_unlock(&sink_lock);
+}
+
+void debug_flush(void) {
+    pthread_mutex_lock(&sink_lock);
+    flush_locked();
+    pthread_mutex_unlock(&sink_lock);
+}
+
+int debug_set_output(const char *path) {
+    int fd = STDERR_FILENO;
+
+    if (path && strcmp(path, "-") != 0) {
+        fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd == -1) {
+            return -1;
+        }
+    }
+
+    pthread_once(&sink_once, sink_init);
+    pthread_mutex_lock(&sink_lock);
+    flush_locked();
+    if (sink_fd != STDERR_FILENO) {
+        close(sink_fd);
+    }
+    sink_fd = fd;
+    snprintf(sink_name, sizeof(sink_name), "%s", fd == STDERR_FILENO ? "stderr" : path);
+    pthread_mutex_unlock(&sink_lock);
+    return 0;
+}
+
+const char* debug_output_name(void) {
+    return sink_name;
+}
+
+debug_level_t set_debug_level(debug_level_t level) {
+    if (level > NUTSHELL_MAX_DEBUG_LEVEL) {
+        level = NUTSHELL_MAX_DEBUG_LEVEL;
+    }
     g_debug_level = level;
+    return level;
 }
 
 const char* debug_level_to_string(debug_level_t level) {
@@ -2,297 +2,298 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
+#include <time.h>
 #include <string.h>
 #include <fcntl.h>  // For open() flags
 #include <errno.h>
 #include "executor.h"
-#include <signal.h>
+#include "launcher.h"
+#include "builtins.h"
+#include "variables.h"
+#include "jobs.h"
+#include "options.h"
+#include "timing.h"
+#include "trace.h"
 #include <debug.h>
 
-// Helper functions  // Note dont define static fun in .h files
-static int has_output_redirection(command_t *cmd) {
-    for (int i = 0; i < cmd->redirect_count; i++) {
-        if (cmd->redirections[i].type == REDIRECT_OUTPUT ||
-            cmd->redirections[i].type == REDIRECT_APPEND ||
-            cmd->redirections[i].type == REDIRECT_BOTH) {
-            return 1;
-        }
+#define JOB_TEXT_MAX 256    // command text kept for jobs listings
+#define PIPESTATUS_TEXT_MAX 256
+#define TIME_STAGE_LABELS 16    // pipelines longer than this print stage numbers only
+
+static int execute_node(const ast_node_t *node, arena_t *arena, int in_child);
+static int execute_simple(command_t *cmd);
+static int execute_leaf(const ast_node_t *node, arena_t *arena);
+static int execute_measured(const ast_node_t *node, arena_t *arena);
+
+// =================================================================
+// Job text: what jobs and "[1]+ Done" show for a command
+// =================================================================
+
+static void append_text(char *buf, size_t size, const char *text) {
+    size_t used = strlen(buf);
+    if (used + 1 < size) {
+        snprintf(buf + used, size - used, "%s", text);
     }
-    return 0;
 }
 
-static int has_input_redirection(command_t *cmd) {
-    for (int i = 0; i < cmd->redirect_count; i++) {
-        if (cmd->redirections[i].type == REDIRECT_INPUT) {
-            return 1;
+static void describe_stages(const command_t *commands, int count, char *buf, size_t size) {
+    buf[0] = '\0';
+    for (int i = 0; i < count; i++) {
+        if (i > 0) append_text(buf, size, " | ");
+        if (commands[i].subshell) {
+            append_text(buf, size, "( ... )");
+            continue;
+        }
+        for (int j = 0; j < commands[i].argc; j++) {
+            if (j > 0) append_text(buf, size, " ");
+            append_text(buf, size, commands[i].args[j]);
         }
     }
-    return 0;
 }
 
+// Unexpanded text, for compound commands run as one background job
+static void describe_node(const ast_node_t *node, char *buf, size_t size) {
+    static const char *redir_ops[] = {"", ">", ">>", "<", "2>", "&>"};
 
-// Apply redirections for a command
-static int apply_redirections(command_t *cmd) {
-    for (int i = 0; i < cmd->redirect_count; i++) {
-        redirection_t *redir = &cmd->redirections[i];
-        int fd;
-        
-        switch (redir->type) {
-            case REDIRECT_OUTPUT:
-                // Open file for writing (create/truncate)
-                fd = open(redir->filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-                if (fd == -1) {
-                    perror("Failed to open output file");
-                    return -1;
-                }
-                if (dup2(fd, STDOUT_FILENO) == -1) {
-                    perror("Failed to redirect stdout");
-                    close(fd);
-                    return -1;
-                }
-                close(fd);
-                break;
-                
-            case REDIRECT_APPEND:
-                // Open file for appending
-                fd = open(redir->filename, O_WRONLY | O_CREAT | O_APPEND, 0644);
-                if (fd == -1) {
-                    perror("Failed to open append file");
-                    return -1;
-                }
-                if (dup2(fd, STDOUT_FILENO) == -1) {
-                    perror("Failed to redirect stdout for append");
-                    close(fd);
-                    return -1;
-                }
-                close(fd);
-                break;
-                
-            case REDIRECT_INPUT:
-                // Open file for reading
-                fd = open(redir->filename, O_RDONLY);
-                if (fd == -1) {
-                    perror("Failed to open input file");
-                    return -1;
-                }
-                if (dup2(fd, STDIN_FILENO) == -1) {
-                    perror("Failed to redirect stdin");
-                    close(fd);
-                    return -1;
-                }
-                close(fd);
-                break;
-                
-            case REDIRECT_ERROR:
-                // Open file for error output
-                fd = open(redir->filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-                if (fd == -1) {
-                    perror("Failed to open error file");
-                    return -1;
-                }
-                if (dup2(fd, STDERR_FILENO) == -1) {
-                    perror("Failed to redirect stderr");
-                    close(fd);
-                    return -1;
-                }
-                close(fd);
-                break;
-                
-            case REDIRECT_BOTH:
-                // Redirect both stdout and stderr to same file
-                fd = open(redir->filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-                if (fd == -1) {
-                    perror("Failed to open combined output file");
-                    return -1;
-                }
-                if (dup2(fd, STDOUT_FILENO) == -1) {
-                    perror("Failed to redirect stdout");
-                    close(fd);
-                    return -1;
-                }
-                if (dup2(fd, STDERR_FILENO) == -1) {
-                    perror("Failed to redirect stderr");
-                    close(fd);
-                    return -1;
+    switch (node->type) {
+        case NODE_COMMAND:
+            for (int i = 0; i < node->count; i++) {
+                if (i > 0) append_text(buf, size, " ");
+                append_text(buf, size, node->words[i].text);
+            }
+            break;
+
+        case NODE_SUBSHELL:
+            append_text(buf, size, "( ");
+            describe_node(node->children[0], buf, size);
+            append_text(buf, size, " )");
+            break;
+
+        case NODE_PIPELINE:
+        case NODE_AND:
+        case NODE_OR:
+        case NODE_LIST:
+            for (int i = 0; i < node->count; i++) {
+                if (i > 0) {
+                    if (node->type == NODE_PIPELINE) append_text(buf, size, " | ");
+                    else if (node->type == NODE_AND) append_text(buf, size, " && ");
+                    else if (node->type == NODE_OR) append_text(buf, size, " || ");
+                    else append_text(buf, size, node->children[i - 1]->background ? " & " : "; ");
                 }
-                close(fd);
-                break;
-                
-            default:
-                break;
-        }
+                describe_node(node->children[i], buf, size);
+            }
+            break;
+    }
+
+    for (int i = 0; i < node->redirect_count; i++) {
+        append_text(buf, size, " ");
+        append_text(buf, size, redir_ops[node->redirections[i].type]);
+        append_text(buf, size, " ");
+        append_text(buf, size, node->redirections[i].target.text);
     }
-    
-    return 0;
 }
 
-void execute_command(char **args, int is_background) {
-    pid_t pid = fork();
-    
+static job_t* create_job_for(const command_t *commands, int count) {
+    char text[JOB_TEXT_MAX];
+    describe_stages(commands, count, text, sizeof(text));
+    job_t *job = job_create(text);
+    if (!job) {
+        DEBUG_ERROR("Out of memory creating job");
+    }
+    return job;
+}
+
+static int finish_job(job_t *job, int is_background) {
+    if (is_background) {
+        job_run_background(job);
+        return 0;  // Background jobs always "succeed" for chaining
+    }
+
+    // The job may be gone afterwards, so its text is taken now
+    char what[TRACE_DETAIL_MAX] = "";
+    uint64_t span = TRACE_BEGIN();
+    if (span) snprintf(what, sizeof(what), "%s", job->command);
+
+    int status = job_run_foreground(job);
+    TRACE_END(span, "wait", what);
+    return status;
+}
+
+// Launch a single external command as its own job and wait unless backgrounded
+static int run_external(command_t *cmd, int is_background) {
+    job_t *job = create_job_for(cmd, 1);
+    if (!job) return 1;
+
+    launch_spec_t spec = {
+        .args = cmd->args,
+        .redirections = cmd->redirections,
+        .redirect_count = cmd->redirect_count,
+        .stdin_fd = -1,
+        .stdout_fd = -1,
+        .close_fds = NULL,
+        .close_count = 0,
+    };
+    job_prepare_launch(job, &spec, !is_background);
+
+    uint64_t span = TRACE_BEGIN();
+    pid_t pid = launch_process(&spec);
+    TRACE_END(span, "spawn", cmd->args[0]);
     if (pid < 0) {
-        perror("fork failed");
-        return;
+        job_discard(job);
+        return report_launch_failure(cmd->args[0]);
     }
-    
-    if (pid == 0) {
-        // Child process
-        
-        // Reset signals to default
-        for (int i = 1; i < 32; i++) {
-            signal(i, SIG_DFL);
-        }
-        
-        execvp(args[0], args);
-        perror("execvp failed");
+
+    job_add_process(job, pid);
+    return finish_job(job, is_background);
+}
+
+// Stages that can't be exec'd run in a forked copy of the shell:
+// subshells, ( list ), and builtins inside a pipeline
+static pid_t fork_stage(const command_t *cmd, int stdin_fd, int stdout_fd,
+                        const int *close_fds, int close_count,
+                        job_t *job, int foreground) {
+    fflush(stdout);
+    uint64_t span = TRACE_BEGIN();
+    pid_t pid = fork();
+
+    if (pid != 0) {
+        TRACE_END(span, "fork", cmd->subshell ? "( )" : cmd->args[0]);
+        if (pid > 0) job_add_process(job, pid);
+        return pid;
+    }
+
+    // Child process
+    job_enter_group(job, foreground);
+
+    if (stdin_fd >= 0 && stdin_fd != STDIN_FILENO) {
+        dup2(stdin_fd, STDIN_FILENO);
+    }
+    if (stdout_fd >= 0 && stdout_fd != STDOUT_FILENO) {
+        dup2(stdout_fd, STDOUT_FILENO);
+    }
+    for (int i = 0; i < close_count; i++) {
+        if (close_fds[i] > STDERR_FILENO)
+            close(close_fds[i]);
+    }
+
+    if (apply_redirections(cmd->redirections, cmd->redirect_count) == -1) {
         _exit(1);
+    }
+
+    int status = 0;
+    if (cmd->subshell) {
+        arena_t child_arena;
+        arena_init(&child_arena);
+        status = execute_node(cmd->subshell, &child_arena, 0);
     } else {
-        // Parent process
-        if (!is_background) {
-            int status;
-            waitpid(pid, &status, 0);
+        const builtin_t *builtin = find_builtin(cmd->args[0]);
+        if (builtin->flags & BUILTIN_CHILD_OK) {
+            status = run_builtin(builtin, cmd->args);  // shell state changes stay in this child
         } else {
-            printf("[Background job] PID: %d\n", pid);
+            fprintf(stderr, "%s: can't run in a pipeline or in the background\n", cmd->args[0]);
+            status = 1;
         }
     }
+    fflush(stdout);
+    _exit(status);  // _exit: don't run the parent's atexit handlers (history)
 }
 
-// New function to execute command with redir
-void execute_command_with_redirections(command_t *cmd) {
-    // Checking if its a built-in command
-    int is_builtin = 0;
-    
-    // List of built-in commands
-    char *builtins[] = {"env", "set", "export", "unset", "cdir", "pcd", "history", "exit", NULL};
-    for (int i = 0; builtins[i]; i++) {
-        if (strcmp(cmd->args[0], builtins[i]) == 0) {
-            is_builtin = 1;
-            break;
-        }
-    }
-    
-    if (is_builtin) {
-        // Handle built-in with redirections in current process
-        
-        // Save original file descriptors  //<---Very Imp for builtin to enable redirections---> 
-        int saved_stdout = dup(STDOUT_FILENO);
-        int saved_stderr = dup(STDERR_FILENO);
-        int saved_stdin = dup(STDIN_FILENO);
-        
-        // Apply redirections
-        if (apply_redirections(cmd) == -1) {
-            // Restore original FDs on error
-            dup2(saved_stdout, STDOUT_FILENO);
-            dup2(saved_stderr, STDERR_FILENO);
-            dup2(saved_stdin, STDIN_FILENO);
-            close(saved_stdout);
-            close(saved_stderr);
-            close(saved_stdin);
-            return;
-        }
-        
-        // Execute the built-in command
-        handle_builtin(cmd->args);
-        
-        // Restore original file descriptors
-        dup2(saved_stdout, STDOUT_FILENO);
-        dup2(saved_stderr, STDERR_FILENO);
-        dup2(saved_stdin, STDIN_FILENO);
-        close(saved_stdout);
-        close(saved_stderr);
-        close(saved_stdin);
-        
-    } else {
-        // Handle external command with redir
-        pid_t pid = fork();
-        
-        if (pid < 0) {
-            perror("fork failed");
-            return;
-        }
-        
-        if (pid == 0) {
-            // Child process
-            for (int i = 1; i < 32; i++) {
-                signal(i, SIG_DFL);
-            }
-            
-            if (apply_redirections(cmd) == -1) {
-                _exit(1);
-            }
-            
-            execvp(cmd->args[0], cmd->args);
-            perror("execvp failed");
-            _exit(1);
-        } else {
-            // Parent process
-            if (!cmd->is_background) {
-                int status;
-                waitpid(pid, &status, 0);
-            } else {
-                printf("[Background job] PID: %d\n", pid);
-            }
-        }
+// Run a builtin in the shell itself with its redirections applied,
+// then put the shell's own stdin/stdout/stderr back
+static int run_builtin_redirected(const builtin_t *builtin, command_t *cmd) {
+    // Save original file descriptors  //<---Very Imp for builtin to enable redirections--->
+    int saved_stdout = dup(STDOUT_FILENO);
+    int saved_stderr = dup(STDERR_FILENO);
+    int saved_stdin = dup(STDIN_FILENO);
+    int status = 1;
+
+    // Apply redirections, and on error just restore the original FDs
+    if (apply_redirections(cmd->redirections, cmd->redirect_count) != -1) {
+        status = run_builtin(builtin, cmd->args);
     }
+
+    // Restore original file descriptors
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    dup2(saved_stderr, STDERR_FILENO);
+    dup2(saved_stdin, STDIN_FILENO);
+    close(saved_stdout);
+    close(saved_stderr);
+    close(saved_stdin);
+    return status;
 }
 
-// Enhanced pipeline execution with redirection support
-void execute_pipeline(command_t *commands, int cmd_count, int is_background) {
+// Enhanced pipeline execution with redirection support. Returns the
+// pipeline's status: the last stage's, or with pipefail the rightmost failure
+int execute_pipeline(command_t *commands, int cmd_count, int is_background) {
     if (cmd_count == 1) {
-        // Single command - check for redirections
-        if (commands[0].redirect_count > 0) {
-            execute_command_with_redirections(&commands[0]);
-        } else {
-            execute_command(commands[0].args, is_background);
-        }
-        return;
+        // Not really a pipeline: same path as any simple command
+        commands[0].is_background = is_background;
+        return execute_simple(&commands[0]);
     }
     
     int pipes[cmd_count - 1][2];
-    pid_t pids[cmd_count];
+    int pipe_fds[2 * (cmd_count - 1)];
+
+    // The whole pipeline is one job (one process group)
+    job_t *job = create_job_for(commands, cmd_count);
+    if (!job) {
+        return 1;
+    }
     
-    // Create all pipes
+    // Create all pipes (close-on-exec, sized by pipesize/NUTSHELL_PIPE_SIZE)
+    int pipe_size = shell_pipe_size();
     for (int i = 0; i < cmd_count - 1; i++) {
-        if (pipe(pipes[i]) == -1) {
+        if (open_pipe(pipes[i], pipe_size) == -1) {
             perror("pipe failed");
-            return;
+            for (int j = 0; j < i; j++) {
+                close(pipes[j][0]);
+                close(pipes[j][1]);
+            }
+            job_discard(job);
+            return 1;
         }
+        pipe_fds[2 * i] = pipes[i][0];
+        pipe_fds[2 * i + 1] = pipes[i][1];
     }
     
-    // Fork and execute each command
+    // Launch each command. Exec'd stages lose the pipe ends they don't own
+    // to O_CLOEXEC; forked shell stages close them by hand.
     for (int i = 0; i < cmd_count; i++) {
-        pids[i] = fork();
-        
-        if (pids[i] == -1) {
-            perror("fork failed");
-            return;
+        if (commands[i].subshell ||
+            (commands[i].argc > 0 && find_builtin(commands[i].args[0]))) {
+            pid_t pid = fork_stage(&commands[i],
+                                      (i > 0) ? pipes[i-1][0] : -1,
+                                      (i < cmd_count - 1) ? pipes[i][1] : -1,
+                                      pipe_fds, 2 * (cmd_count - 1),
+                                      job, !is_background);
+            if (pid == -1) {
+                perror("fork failed");
+                job_add_result(job, 1);
+            }
+            continue;
         }
+
+        launch_spec_t spec = {
+            .args = commands[i].args,
+            .redirections = commands[i].redirections,
+            .redirect_count = commands[i].redirect_count,
+            .stdin_fd = (i > 0) ? pipes[i-1][0] : -1,
+            .stdout_fd = (i < cmd_count - 1) ? pipes[i][1] : -1,
+            .close_fds = NULL,      // O_CLOEXEC closes the other ends at exec
+            .close_count = 0,
+        };
+        job_prepare_launch(job, &spec, !is_background);
         
-        if (pids[i] == 0) {
-            // Child process
-            
-            // Set up pipes (only if no conflicting redirections)
-            if (i > 0 && !has_input_redirection(&commands[i])) {
-                dup2(pipes[i-1][0], STDIN_FILENO);
-            }
-            
-            if (i < cmd_count - 1 && !has_output_redirection(&commands[i])) {
-                dup2(pipes[i][1], STDOUT_FILENO);
-            }
-            
-            // Close all pipe file descriptors
-            for (int j = 0; j < cmd_count - 1; j++) {
-                close(pipes[j][0]);
-                close(pipes[j][1]);
-            }
-            
-            // Apply any redirections for this command
-            if (apply_redirections(&commands[i]) == -1) {
-                _exit(1);
-            }
-            
-            execvp(commands[i].args[0], commands[i].args);
-            perror("execvp failed");
-            _exit(1);
+        // A stage that can't start doesn't stop the rest (like bash)
+        uint64_t span = TRACE_BEGIN();
+        pid_t pid = launch_process(&spec);
+        TRACE_END(span, "spawn", commands[i].args[0]);
+        if (pid == -1) {
+            job_add_result(job, report_launch_failure(commands[i].args[0]));
+        } else {
+            job_add_process(job, pid);
         }
     }
     
@@ -302,90 +303,252 @@ void execute_pipeline(command_t *commands, int cmd_count, int is_background) {
         close(pipes[i][1]);
     }
     
-    // Wait for all processes
-    if (!is_background) {
-        for (int i = 0; i < cmd_count; i++) {
-            int status;
-            waitpid(pids[i], &status, 0);
+    // Wait for all processes, or hand the job to the job table
+    return finish_job(job, is_background);
+}
+
+
+// Run one expanded simple command (or subshell) in the foreground/background
+static int execute_simple(command_t *cmd) {
+    int last_exit_status = 0;
+
+    if (cmd->subshell) {
+        job_t *job = create_job_for(cmd, 1);
+        if (!job) return 1;
+
+        pid_t pid = fork_stage(cmd, -1, -1, NULL, 0, job, !cmd->is_background);
+        if (pid < 0) {
+            perror("fork failed");
+            job_discard(job);
+            return 1;
         }
-    } else {
-        DEBUG_INFO("[Background pipeline] PIDs: ");
-        for (int i = 0; i < cmd_count; i++) {
-            DEBUG_VERBOSE("%d ", pids[i]);
+        return finish_job(job, cmd->is_background);
+    }
+
+    if (cmd->argc == 0) {
+        return 0;  // Expanded to nothing
+    }
+
+    // NAME=value on its own is an assignment
+    if (cmd->argc == 1 && cmd->redirect_count == 0 && is_assignment(cmd->args[0])) {
+        assign_variable(cmd->args[0]);
+        return 0;
+    }
+
+    DEBUG_INFO("Executing: %s", cmd->args[0]);
+
+    const builtin_t *builtin = find_builtin(cmd->args[0]);
+
+    if (builtin && cmd->is_background && !(builtin->flags & BUILTIN_SHELL_STATE)) {
+        // Nothing to keep in the shell, so `jobs &` or `fcat big &` is a job
+        job_t *job = create_job_for(cmd, 1);
+        if (!job) return 1;
+
+        if (fork_stage(cmd, -1, -1, NULL, 0, job, 0) < 0) {
+            perror("fork failed");
+            job_discard(job);
+            return 1;
         }
-        DEBUG_INFO("\n");
+        last_exit_status = finish_job(job, 1);
+    } else if (builtin && cmd->redirect_count > 0) {
+        last_exit_status = run_builtin_redirected(builtin, cmd);
+    } else if (builtin) {
+        last_exit_status = run_builtin(builtin, cmd->args);
+    } else {
+        // Execute external command (file actions do any redirections)
+        last_exit_status = run_external(cmd, cmd->is_background);
     }
+
+    DEBUG_INFO("Command '%s' exited with status: %d", cmd->args[0], last_exit_status);
+    return last_exit_status;
 }
 
+// @? and PIPESTATUS after a pipeline (stages > 1) or simple command.
+// Stage statuses come from the foreground job that just finished.
+static void publish_status(int status, int stages) {
+    char text[PIPESTATUS_TEXT_MAX];
+    const job_result_t *results;
+    size_t len = 0;
 
-// Get exit status from a command execution
-int get_command_exit_status(char **args, int is_background) {
+    set_last_status(status);
+
+    if (stages > 1 && job_last_results(&results) != stages) {
+        stages = 1;  // no job ran (pipe failed), nothing better to say
+    }
+    text[0] = '\0';
+    for (int i = 0; i < stages && len < sizeof(text); i++) {
+        len += snprintf(text + len, sizeof(text) - len, i ? " %d" : "%d",
+                        stages > 1 ? results[i].status : status);
+    }
+    set_variable("PIPESTATUS", text, 0);
+}
+
+// Run a compound node (a && b, ( x ), ...) with & in a forked child
+static int execute_in_background(const ast_node_t *node, arena_t *arena) {
+    char text[JOB_TEXT_MAX] = "";
+    describe_node(node, text, sizeof(text));
+    job_t *job = job_create(text);
+    if (!job) return 1;
+
+    fflush(stdout);
+    uint64_t span = TRACE_BEGIN();
     pid_t pid = fork();
-    
+
     if (pid < 0) {
         perror("fork failed");
-        return 1;  // Return failure status
+        job_discard(job);
+        return 1;
     }
-    
+    if (pid > 0) TRACE_END(span, "fork", text);
+
     if (pid == 0) {
-        // Child process
-        for (int i = 1; i < 32; i++) {
-            signal(i, SIG_DFL);
+        job_enter_group(job, 0);
+        int status = execute_node(node, arena, 1);
+        fflush(stdout);
+        _exit(status);
+    }
+
+    job_add_process(job, pid);
+    return finish_job(job, 1);
+}
+
+// in_child: node's own & was already handled by forking
+static int execute_node(const ast_node_t *node, arena_t *arena, int in_child) {
+    int status = 0;
+
+    if (node->background && !in_child &&
+        (node->type == NODE_AND || node->type == NODE_OR || node->type == NODE_LIST)) {
+        return execute_in_background(node, arena);
+    }
+
+    switch (node->type) {
+        case NODE_LIST:
+            for (int i = 0; i < node->count; i++) {
+                status = execute_node(node->children[i], arena, 0);
+            }
+            return status;
+
+        case NODE_AND:
+            // && : Execute only if previous command succeeded (exit status 0)
+            status = execute_node(node->children[0], arena, 0);
+            DEBUG_INFO("&& operator: last_status=%d, executing=%s",
+                      status, status == 0 ? "yes" : "no");
+            if (status == 0) {
+                status = execute_node(node->children[1], arena, 0);
+            }
+            return status;
+
+        case NODE_OR:
+            // || : Execute only if previous command failed (exit status != 0)
+            status = execute_node(node->children[0], arena, 0);
+            DEBUG_INFO("|| operator: last_status=%d, executing=%s",
+                      status, status != 0 ? "yes" : "no");
+            if (status != 0) {
+                status = execute_node(node->children[1], arena, 0);
+            }
+            return status;
+
+        case NODE_PIPELINE:
+        case NODE_COMMAND:
+        case NODE_SUBSHELL:
+            if ((node->timed || shell_options.timing) && !node->background) {
+                return execute_measured(node, arena);
+            }
+            return execute_leaf(node, arena);
+    }
+
+    return status;
+}
+
+// A pipeline or simple command: expand, run, publish @? and PIPESTATUS
+static int execute_leaf(const ast_node_t *node, arena_t *arena) {
+    int status;
+
+    job_forget_results();
+
+    switch (node->type) {
+        case NODE_PIPELINE: {
+            command_t *stages = arena_alloc(arena, node->count * sizeof(command_t));
+            if (!stages) {
+                return 1;
+            }
+            for (int i = 0; i < node->count; i++) {
+                if (expand_command(node->children[i], &stages[i], arena) != 0) {
+                    DEBUG_ERROR("Expansion failed");
+                    return 1;
+                }
+            }
+            status = execute_pipeline(stages, node->count, node->background);
+            publish_status(status, node->background ? 1 : node->count);
+            return status;
         }
-        
-        execvp(args[0], args);
-        perror("execvp failed");
-        _exit(127);  // Command not found
-    } else {
-        // Parent process
-        if (!is_background) {
-            int status;
-            waitpid(pid, &status, 0);
-            
-            if (WIFEXITED(status)) {
-                return WEXITSTATUS(status);  // Return actual exit code
-            } else {
-                return 1;  // Command terminated abnormally
+
+        case NODE_COMMAND:
+        case NODE_SUBSHELL: {
+            command_t cmd;
+            if (expand_command(node, &cmd, arena) != 0) {
+                DEBUG_ERROR("Expansion failed");
+                return 1;
             }
-        } else {
-            printf("[Background job] PID: %d\n", pid);
-            return 0;  // Background jobs always "succeed" for chaining
+            status = execute_simple(&cmd);
+            publish_status(status, 1);
+            return status;
         }
+
+        default:
+            return 0;
     }
 }
 
+// execute_leaf plus wall clock and rusage, for `time` and `set -o timing`
+static int execute_measured(const ast_node_t *node, arena_t *arena) {
+    timing_record_t rec;
+    struct rusage self_before, self_after;
+    struct timespec start, end;
+    const job_result_t *results;
 
-int execute_external_command_with_status(char **args, int is_background) {
-    pid_t pid = fork();
-    
-    if (pid < 0) {
-        DEBUG_ERROR("Fork failed");
-        return 1;  // Return failure status
-    }
-    
-    if (pid == 0) {
-        // Child process
-        for (int i = 1; i < 32; i++) {
-            signal(i, SIG_DFL);
-        }
-        
-        execvp(args[0], args);
-        DEBUG_ERROR("execvp failed");
-        _exit(127);  // Command not found
-    } else {
-        // Parent process
-        if (!is_background) {
-            int status;
-            waitpid(pid, &status, 0);
-            
-            if (WIFEXITED(status)) {
-                return WEXITSTATUS(status);  // Return actual exit code
-            } else {
-                return 1;  // Command terminated abnormally
+    getrusage(RUSAGE_SELF, &self_before);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    int status = execute_leaf(node, arena);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    getrusage(RUSAGE_SELF, &self_after);
+
+    int count = job_last_results(&results);
+    rec.command[0] = '\0';
+    describe_node(node, rec.command, sizeof(rec.command));
+    rec.status = status;
+    rec.wall = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    timing_summarize(&rec, results, count, &self_before, &self_after);
+
+    if (node->timed) {
+        // Label each stage with its own text when the job has one per stage
+        const char *labels[TIME_STAGE_LABELS];
+        char label_text[TIME_STAGE_LABELS][JOB_TEXT_MAX];
+        int labelled = node->type == NODE_PIPELINE ? node->count : 1;
+
+        if (labelled == count && count <= TIME_STAGE_LABELS) {
+            for (int i = 0; i < count; i++) {
+                label_text[i][0] = '\0';
+                describe_node(node->type == NODE_PIPELINE ? node->children[i] : node,
+                              label_text[i], JOB_TEXT_MAX);
+                labels[i] = label_text[i];
             }
+            timing_report(&rec, results, count, labels);
         } else {
-            printf("[Background job] PID: %d\n", pid);
-            return 0;  // Background jobs always "succeed" for chaining
+            timing_report(&rec, results, count, NULL);
         }
     }
+    if (shell_options.timing) {
+        timing_log(&rec);
+    }
+    return status;
+}
+
+int execute_ast(const ast_node_t *node, arena_t *arena) {
+    if (!node) {
+        return 0;
+    }
+    return execute_node(node, arena, 0);
 }
@@ -1,19 +1,36 @@
+#define _GNU_SOURCE     // memrchr
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <signal.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <limits.h>
+#include <readline/readline.h>
+#include <readline/history.h>
 #include "history.h"
+#include "variables.h"
 #include <debug.h>
 
-static char *history[MAX_HISTORY];
+static char **history = NULL;         // ring buffer, oldest at history_start
+static int history_cap = 0;           // HISTSIZE, read once at startup
+static int history_start = 0;
 static int history_count = 0;
-static int history_modified = 0;  // Track if we need to save
+static int history_unsaved = 0;       // newest entries not yet appended to the file
+static int history_first_number = 1;  // number shown for the oldest entry
 
-// Get history file path
+// Get history file path (resolved once, the save at exit runs after
+// the variable table is gone)
 static char* get_history_file_path(void) {
     static char path[1024];
-    char *home = getenv("HOME");
+    if (path[0]) return path;
+
+    char *home = get_variable("HOME");
     
     if (home) {
         snprintf(path, sizeof(path), "%s/%s", home, HISTORY_FILE);
@@ -24,11 +41,130 @@ static char* get_history_file_path(void) {
     return path;
 }
 
+// i = 0 is the oldest entry
+static char* history_at(int i) {
+    return history[(history_start + i) % history_cap];
+}
+
+// Append to the ring, dropping the oldest entry once it's full
+static void push_entry(char *entry) {
+    if (history_cap == 0) {
+        free(entry);
+    } else if (history_count == history_cap) {
+        free(history[history_start]);
+        history[history_start] = entry;
+        history_start = (history_start + 1) % history_cap;
+        history_first_number++;
+    } else {
+        history[(history_start + history_count) % history_cap] = entry;
+        history_count++;
+    }
+}
+
+// =================================================================
+// Trigram index: every 3-byte window of an entry maps to a bucket holding
+// the numbers of the entries that contain it (ascending). Searches only
+// verify entries from the smallest bucket of the pattern's trigrams.
+// Entries that fell off the ring are dropped lazily from the front.
+// =================================================================
+
+typedef struct {
+    int *numbers;
+    int head;       // first live number, older ones were evicted
+    int count;
+    int cap;
+} posting_t;
+
+static posting_t trigram_index[TRIGRAM_BUCKETS];
+static int indexed_through = 0;     // highest entry number in the index
+static int index_ready = 0;         // built on the first search, then kept current
+
+static unsigned int trigram_bucket(const char *p) {
+    unsigned int t = ((unsigned char)p[0] << 16) | ((unsigned char)p[1] << 8) | (unsigned char)p[2];
+    return (t * 2654435761u) >> (32 - TRIGRAM_BITS);
+}
+
+// Drop numbers that left the ring, compacting once half the list is dead
+static void prune_posting(posting_t *list) {
+    while (list->head < list->count && list->numbers[list->head] < history_first_number) {
+        list->head++;
+    }
+    if (list->head > 0 && list->head * 2 >= list->count) {
+        memmove(list->numbers, list->numbers + list->head,
+                (list->count - list->head) * sizeof(int));
+        list->count -= list->head;
+        list->head = 0;
+    }
+}
+
+static void index_entry(const char *text, int number) {
+    size_t len = strlen(text);
+
+    for (size_t i = 0; i + 3 <= len; i++) {
+        posting_t *list = &trigram_index[trigram_bucket(text + i)];
+
+        // Same trigram twice in one entry
+        if (list->count > list->head && list->numbers[list->count - 1] == number) continue;
+
+        if (list->count == list->cap) {
+            prune_posting(list);
+        }
+        if (list->count == list->cap) {
+            int new_cap = list->cap ? list->cap * 2 : 8;
+            int *grown = realloc(list->numbers, new_cap * sizeof(int));
+            if (!grown) continue;  // just a missed hint, searches verify anyway
+            list->numbers = grown;
+            list->cap = new_cap;
+        }
+        list->numbers[list->count++] = number;
+    }
+}
+
+// Index whatever was added (or loaded) since the last call
+static void catch_up_index(void) {
+    int newest = history_first_number + history_count - 1;
+    int from = indexed_through + 1;
+    if (from < history_first_number) from = history_first_number;
+
+    for (int number = from; number <= newest; number++) {
+        index_entry(history_at(number - history_first_number), number);
+    }
+    indexed_through = newest;
+    index_ready = 1;
+}
+
+static void clear_index(void) {
+    for (int i = 0; i < TRIGRAM_BUCKETS; i++) {
+        free(trigram_index[i].numbers);
+    }
+    memset(trigram_index, 0, sizeof(trigram_index));
+    indexed_through = 0;
+    index_ready = 0;
+}
+
+// HISTSIZE from the environment/shell, DEFAULT_HISTSIZE otherwise
+static int read_histsize(void) {
+    const char *value = get_variable("HISTSIZE");
+    if (value) {
+        long size = strtol(value, NULL, 10);
+        if (size > 0 && size <= INT_MAX / 2) return (int)size;
+    }
+    return DEFAULT_HISTSIZE;
+}
+
 void init_history(void) {
     // Initialize history array
-    for (int i = 0; i < MAX_HISTORY; i++) {
-        history[i] = NULL;
+    free(history);
+    history_cap = read_histsize();
+    history = calloc(history_cap, sizeof(char*));
+    if (!history) {
+        DEBUG_ERROR("Out of memory allocating history for %d entries", history_cap);
+        history_cap = 0;
     }
+    history_start = 0;
+    history_count = 0;
+    history_unsaved = 0;
+    history_first_number = 1;
     
     // Load existing history from file
     load_history_from_file();
@@ -38,74 +174,434 @@ void add_to_history(const char *cmd) {
     if (!cmd || strlen(cmd) == 0) return;
     
     // Don't add duplicate consecutive commands
-    if (history_count > 0 && history[history_count - 1] && 
-        strcmp(history[history_count - 1], cmd) == 0) {
+    if (history_count > 0 && strcmp(history_at(history_count - 1), cmd) == 0) {
         return;
     }
     
-    // If history is full, remove oldest entry (circular buffer behavior by bash mimiced  )
-    if (history_count >= MAX_HISTORY) {
-        free(history[0]);
-        // Shift all entries left
-        for (int i = 0; i < MAX_HISTORY - 1; i++) {
-            history[i] = history[i + 1];
-        }
-        history_count = MAX_HISTORY - 1;
+    char *entry = strdup(cmd);
+    if (!entry) return;
+
+    push_entry(entry);
+    if (history_unsaved < history_count) {
+        history_unsaved++;
+    }
+
+    // Loaded history is indexed on the first search; after that, keep up
+    if (index_ready) {
+        catch_up_index();
     }
-    
-    // Add new command
-    history[history_count] = strdup(cmd);
-    history_count++;
-    history_modified = 1;
 }
 
 void print_history(void) {
     for (int i = 0; i < history_count; i++) {
-        printf("%d: %s\n", i + 1, history[i]);
+        printf("%d: %s\n", history_first_number + i, history_at(i));
+    }
+}
+
+// Hand the loaded entries to readline in one go (arrow keys, Ctrl-R)
+// instead of one add_history() per line
+static void feed_readline_history(void) {
+    HIST_ENTRY **entries = malloc((history_count + 1) * sizeof(HIST_ENTRY*));
+    if (!entries) return;
+
+    for (int i = 0; i < history_count; i++) {
+        entries[i] = alloc_history_entry(history_at(i), NULL);
+    }
+    entries[history_count] = NULL;
+
+    HISTORY_STATE state = {0};
+    state.entries = entries;
+    state.offset = history_count;
+    state.length = history_count;
+    state.size = history_count + 1;
+    history_set_history_state(&state);
+    stifle_history(history_cap);
+}
+
+// =================================================================
+// Search
+// =================================================================
+
+// Numbers of the entries worth checking, newest first. Returns a malloc'd
+// array (NULL if every entry must be scanned, i.e. pattern under 3 bytes).
+static int* search_candidates(const char *pattern, int *count) {
+    size_t len = strlen(pattern);
+    if (len < 3) return NULL;
+
+    catch_up_index();
+
+    // The rarest trigram of the pattern bounds the work
+    posting_t *best = NULL;
+    for (size_t i = 0; i + 3 <= len; i++) {
+        posting_t *list = &trigram_index[trigram_bucket(pattern + i)];
+        prune_posting(list);
+        if (!best || list->count - list->head < best->count - best->head) {
+            best = list;
+        }
+    }
+
+    int n = best->count - best->head;
+    int *numbers = malloc((n ? n : 1) * sizeof(int));
+    if (!numbers) return NULL;
+
+    for (int i = 0; i < n; i++) {
+        numbers[i] = best->numbers[best->count - 1 - i];
+    }
+    *count = n;
+    return numbers;
+}
+
+static int compare_text(const void *a, const void *b) {
+    const history_match_t *x = a;
+    const history_match_t *y = b;
+    int cmp = strcmp(x->text, y->text);
+    return cmp ? cmp : y->number - x->number;  // newest first within a command
+}
+
+static int compare_score(const void *a, const void *b) {
+    const history_match_t *x = a;
+    const history_match_t *y = b;
+    if (x->score != y->score) return x->score < y->score ? 1 : -1;
+    return y->number - x->number;
+}
+
+// Every entry containing pattern, one per distinct command, best first.
+// Score = uses / (1 + age / HISTORY_RECENCY_SCALE): frequent and recent
+// commands win. Returns how many were stored (at most max).
+int search_history(const char *pattern, history_match_t *out, int max) {
+    if (!pattern || !*pattern || history_count == 0 || max <= 0) return 0;
+
+    int candidate_count = 0;
+    int *candidates = search_candidates(pattern, &candidate_count);
+    if (!candidates) {
+        candidate_count = history_count;
+    }
+
+    history_match_t *matches = malloc(candidate_count * sizeof(history_match_t));
+    if (!matches) {
+        free(candidates);
+        return 0;
+    }
+
+    int found = 0;
+    for (int i = 0; i < candidate_count; i++) {
+        int number = candidates ? candidates[i] : history_first_number + history_count - 1 - i;
+        int slot = number - history_first_number;
+        if (slot < 0 || slot >= history_count) continue;
+
+        const char *text = history_at(slot);
+        if (strstr(text, pattern)) {
+            matches[found].text = text;
+            matches[found].number = number;
+            matches[found].count = 1;
+            found++;
+        }
+    }
+    free(candidates);
+
+    // Fold repeats of the same command into its newest occurrence
+    qsort(matches, found, sizeof(history_match_t), compare_text);
+    int newest = history_first_number + history_count - 1;
+    int distinct = 0;
+    for (int i = 0; i < found; i++) {
+        if (distinct > 0 && strcmp(matches[distinct - 1].text, matches[i].text) == 0) {
+            matches[distinct - 1].count++;
+            continue;
+        }
+        matches[distinct++] = matches[i];
+    }
+    for (int i = 0; i < distinct; i++) {
+        double age = newest - matches[i].number;
+        matches[i].score = matches[i].count / (1.0 + age / HISTORY_RECENCY_SCALE);
+    }
+    qsort(matches, distinct, sizeof(history_match_t), compare_score);
+
+    int stored = distinct < max ? distinct : max;
+    memcpy(out, matches, stored * sizeof(history_match_t));
+    free(matches);
+    return stored;
+}
+
+void print_history_matches(const char *pattern) {
+    history_match_t matches[HISTORY_SEARCH_MAX];
+    int found = search_history(pattern, matches, HISTORY_SEARCH_MAX);
+
+    for (int i = 0; i < found; i++) {
+        printf("%d: %s\n", matches[i].number, matches[i].text);
     }
 }
 
+// Ctrl-R: search for what's typed so far, replace the line with the best
+// match; pressing it again steps to the next one. On an empty line it's
+// readline's usual reverse-i-search.
+static int history_search_key(int count, int key) {
+    static history_match_t matches[HISTORY_SEARCH_MAX];
+    static int match_count = 0;
+    static int current = 0;
+
+    if (rl_last_func != history_search_key) {
+        if (rl_end == 0) {
+            return rl_reverse_search_history(count, key);
+        }
+
+        char *pattern = strndup(rl_line_buffer, rl_end);
+        if (!pattern) return 0;
+        match_count = search_history(pattern, matches, HISTORY_SEARCH_MAX);
+        free(pattern);
+        current = 0;
+    } else {
+        current++;
+    }
+
+    if (current >= match_count) {
+        current = match_count;  // stay past the end until a new search
+        rl_ding();
+        return 0;
+    }
+
+    rl_replace_line(matches[current].text, 0);
+    rl_point = rl_end;
+    return 0;
+}
+
+void init_history_search(void) {
+    rl_bind_key(CTRL('R'), history_search_key);
+}
+
+// mmap the file and walk newlines backwards from the end, so only the
+// newest HISTSIZE lines are ever touched, however big the file is
 void load_history_from_file(void) {
-    FILE *file = fopen(get_history_file_path(), "r");
-    if (!file) return;  // File doesn't exist yet, that's OK
-    
-    char line[1024];
-    while (fgets(line, sizeof(line), file) && history_count < MAX_HISTORY) {
-
-        // Remove newline
-        line[strcspn(line, "\n")] = 0;
-        
-        if (strlen(line) > 0) {
-            history[history_count] = strdup(line);
-            history_count++;
+    int fd = open(get_history_file_path(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return;  // File doesn't exist yet, that's OK
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size == 0 || history_cap == 0) {
+        close(fd);
+        return;
+    }
+
+    char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        DEBUG_WARN("Can't map history file: %s", strerror(errno));
+        return;
+    }
+
+    // Backwards: find where the oldest line we keep starts
+    const char *end = map + st.st_size;
+    const char *from = end;
+    const char *line_end = end;
+    int found = 0;
+
+    while (found < history_cap && line_end > map) {
+        const char *nl = memrchr(map, '\n', line_end - map);
+        const char *line_start = nl ? nl + 1 : map;
+
+        if (line_end > line_start) {
+            found++;
+            from = line_start;
         }
+        if (!nl) break;
+        line_end = nl;
     }
-    
-    fclose(file);
-    printf("Loaded %d commands from history\n", history_count);
+
+    // Forwards from there: copy each non-empty line, any length
+    const char *pos = from;
+    while (pos < end) {
+        const char *nl = memchr(pos, '\n', end - pos);
+        size_t len = nl ? (size_t)(nl - pos) : (size_t)(end - pos);
+
+        if (len > 0) {
+            char *entry = strndup(pos, len);
+            if (entry) push_entry(entry);
+        }
+        pos += len + 1;
+    }
+
+    munmap(map, st.st_size);
+    feed_readline_history();
+    DEBUG_INFO("Loaded %d commands from history (HISTSIZE %d)", history_count, history_cap);
+}
+
+// =================================================================
+// Persistence: every session only ever appends its own new entries
+// (O_APPEND + flock), so concurrent shells interleave instead of
+// overwriting each other. Compaction rewrites the file via rename.
+// =================================================================
+
+// Byte limit before compaction (NUTSHELL_HISTFILE_MAX, default 1 MB).
+// Remembered, since the final save at exit runs after the variables are gone.
+static long history_file_max(void) {
+    static long max = HISTORY_FILE_MAX;
+    const char *value = get_variable("NUTSHELL_HISTFILE_MAX");
+
+    if (value) {
+        char *end;
+        long parsed = strtol(value, &end, 10);
+        if (*end == 'k' || *end == 'K') parsed *= 1024;
+        else if (*end == 'm' || *end == 'M') parsed *= 1024 * 1024;
+        if (parsed >= 4096) max = parsed;
+    }
+    return max;
+}
+
+// Open for appending with an exclusive lock. If another session compacted
+// (renamed a new file into place) while we waited for the lock, our fd
+// points at the old file, so open again.
+static int open_history_locked(const char *path) {
+    for (int attempt = 0; attempt < 100; attempt++) {
+        int fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+        if (fd == -1) return -1;
+
+        if (flock(fd, LOCK_EX) == -1) {
+            close(fd);
+            return -1;
+        }
+
+        struct stat fd_st, path_st;
+        if (fstat(fd, &fd_st) == 0 && stat(path, &path_st) == 0 &&
+            fd_st.st_ino == path_st.st_ino && fd_st.st_dev == path_st.st_dev) {
+            return fd;
+        }
+        close(fd);
+    }
+
+    errno = EAGAIN;
+    return -1;
+}
+
+static int writev_all(int fd, struct iovec *iov, int count) {
+    while (count > 0) {
+        ssize_t n = writev(fd, iov, count);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+
+        // Short write: skip what went out and retry the rest
+        while (count > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char*)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+// Keep the newest half of the limit, cut at a line boundary. Called with
+// the lock held; readers never see a partial file thanks to rename().
+static void compact_history_file(const char *path, off_t size, long max) {
+    int in = open(path, O_RDONLY | O_CLOEXEC);
+    if (in == -1) return;
+
+    off_t keep_from = size - max / 2;
+    size_t keep = size - keep_from;
+    char *buf = malloc(keep);
+    if (!buf) {
+        close(in);
+        return;
+    }
+
+    ssize_t got = pread(in, buf, keep, keep_from);
+    close(in);
+    if (got != (ssize_t)keep) {
+        free(buf);
+        return;
+    }
+
+    // Skip the partial line we landed in
+    char *start = memchr(buf, '\n', keep);
+    start = start ? start + 1 : buf + keep;
+
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", path, (int)getpid());
+    int out = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (out == -1) {
+        free(buf);
+        return;
+    }
+
+    struct iovec iov = {start, (size_t)(buf + keep - start)};
+    int ok = writev_all(out, &iov, 1) == 0 && fsync(out) == 0;
+    close(out);
+
+    if (ok && rename(tmp, path) == 0) {
+        DEBUG_INFO("History file compacted: %ld -> %zu bytes", (long)size, iov.iov_len);
+    } else {
+        unlink(tmp);
+    }
+    free(buf);
 }
 
 void save_history_to_file(void) {
-    if (!history_modified) {
+    if (history_unsaved == 0) {
         return;  // No changes to save 
     }
     
-    FILE *file = fopen(get_history_file_path(), "w");
-    if (!file) {
+    const char *path = get_history_file_path();
+    int fd = open_history_locked(path);
+    if (fd == -1) {
         perror("Failed to save history");
         return;
     }
     
-    // Writing all commands to file
-    for (int i = 0; i < history_count; i++) {
-        if (history[i]) {
-            DEBUG_VERBOSE("%s\n", history[i]);
+    // Two iovecs per entry (text + newline), one writev per batch
+    struct iovec iov[HISTORY_IOV_BATCH];
+    static char newline[] = "\n";
+    int count = 0;
+    int failed = 0;
+
+    for (int i = history_count - history_unsaved; i < history_count && !failed; i++) {
+        char *entry = history_at(i);
+        iov[count].iov_base = entry;
+        iov[count].iov_len = strlen(entry);
+        iov[count + 1].iov_base = newline;
+        iov[count + 1].iov_len = 1;
+        count += 2;
+
+        if (count == HISTORY_IOV_BATCH) {
+            failed = writev_all(fd, iov, count) != 0;
+            count = 0;
         }
     }
-    
-    fclose(file);
-    history_modified = 0;  // Reset modification flag
-    printf("History saved to %s\n", get_history_file_path());
+    if (!failed && count > 0) {
+        failed = writev_all(fd, iov, count) != 0;
+    }
+
+    if (failed) {
+        perror("Failed to save history");
+    } else {
+        DEBUG_VERBOSE("Appended %d history entries to %s", history_unsaved, path);
+        history_unsaved = 0;
+
+        struct stat st;
+        long max = history_file_max();
+        if (fstat(fd, &st) == 0 && st.st_size > max) {
+            compact_history_file(path, st.st_size, max);
+        }
+    }
+
+    close(fd);  // releases the lock
+}
+
+// history -c: forget the in-memory list (the file keeps what was saved)
+void clear_history_entries(void) {
+    for (int i = 0; i < history_count; i++) {
+        free(history_at(i));
+    }
+    for (int i = 0; i < history_cap; i++) {
+        history[i] = NULL;
+    }
+    clear_history();  // readline's copy too
+    history_start = 0;
+    history_count = 0;
+    history_unsaved = 0;
+    history_first_number = 1;
+    clear_index();
 }
 
 void cleanup_history(void) {
@@ -113,9 +609,8 @@ void cleanup_history(void) {
     save_history_to_file();
     
     // Free all allocated memory
-    for (int i = 0; i < history_count; i++) {
-        free(history[i]);
-        history[i] = NULL;
-    }
-    history_count = 0;
+    clear_history_entries();
+    free(history);
+    history = NULL;
+    history_cap = 0;
 }
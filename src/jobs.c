@@ -0,0 +1,656 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <ctype.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "jobs.h"
+#include "options.h"
+#include "debug.h"
+
+static job_t *job_list = NULL;      // background and stopped jobs, sorted by id
+static unsigned long job_seq = 0;
+static int job_control = 0;
+static pid_t shell_pgid = 0;
+static struct termios shell_tmodes;
+static int sig_pipe[2] = {-1, -1};  // SIGCHLD self-pipe
+static int jobs_inherited = 0;      // forked child: job_list is the parent's, read-only
+static job_result_t *last_results = NULL;   // last foreground job (PIPESTATUS, time)
+static int last_result_count = 0;
+static int last_result_cap = 0;
+
+// The only thing done in signal context: wake the main loop up
+static void sigchld_handler(int signo) {
+    (void)signo;
+    int saved_errno = errno;
+    char byte = 0;
+    if (write(sig_pipe[1], &byte, 1) < 0) {
+        // Pipe full: the main loop has a wake-up pending already
+    }
+    errno = saved_errno;
+}
+
+static int set_nonblock_cloexec(int fd) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) return -1;
+    return fcntl(fd, F_SETFD, FD_CLOEXEC);
+}
+
+void init_job_control(int interactive) {
+    if (!interactive || !isatty(STDIN_FILENO)) return;
+
+    // Started in the background (nutshell &): wait until we own the terminal
+    while (tcgetpgrp(STDIN_FILENO) != (shell_pgid = getpgrp())) {
+        kill(-shell_pgid, SIGTTIN);
+    }
+
+    signal(SIGTSTP, SIG_IGN);
+    signal(SIGTTIN, SIG_IGN);
+    signal(SIGTTOU, SIG_IGN);
+
+    // Own process group (fails harmlessly if we already lead a session)
+    if (setpgid(0, 0) == 0) {
+        shell_pgid = getpid();
+    }
+    tcsetpgrp(STDIN_FILENO, shell_pgid);
+    tcgetattr(STDIN_FILENO, &shell_tmodes);
+
+    if (pipe(sig_pipe) == -1 ||
+        set_nonblock_cloexec(sig_pipe[0]) == -1 ||
+        set_nonblock_cloexec(sig_pipe[1]) == -1) {
+        DEBUG_ERROR("job control: self-pipe failed: %s", strerror(errno));
+        return;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sigchld_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;   // no SA_NOCLDSTOP: stopped background jobs are news
+    sigaction(SIGCHLD, &sa, NULL);
+
+    job_control = 1;
+    DEBUG_INFO("Job control enabled, shell pgid %d", shell_pgid);
+}
+
+int job_control_enabled(void) {
+    return job_control;
+}
+
+int job_signal_fd(void) {
+    return sig_pipe[0];
+}
+
+static void free_job(job_t *job) {
+    free(job->command);
+    free(job->procs);
+    free(job);
+}
+
+void jobs_enter_child(void) {
+    job_control = 0;
+
+    if (sig_pipe[0] >= 0) {
+        close(sig_pipe[0]);
+        close(sig_pipe[1]);
+        sig_pipe[0] = sig_pipe[1] = -1;
+    }
+
+    // The parent's jobs stay listed for jobs and kill in a pipeline
+    // (jobs | cat), but they aren't ours to wait for
+    jobs_inherited = 1;
+
+    int sigs[] = {SIGCHLD, SIGINT, SIGQUIT, SIGTERM, SIGTSTP, SIGTTIN, SIGTTOU};
+    for (size_t i = 0; i < sizeof(sigs) / sizeof(sigs[0]); i++) {
+        signal(sigs[i], SIG_DFL);
+    }
+}
+
+// =================================================================
+// Job table
+// =================================================================
+
+static void insert_job(job_t *job) {
+    job_t **link = &job_list;
+    int id = 1;
+
+    while (*link) {
+        id = (*link)->id + 1;
+        link = &(*link)->next;
+    }
+
+    job->id = id;
+    job->next = NULL;
+    *link = job;
+}
+
+static void remove_job(job_t *job) {
+    for (job_t **link = &job_list; *link; link = &(*link)->next) {
+        if (*link == job) {
+            *link = job->next;
+            job->next = NULL;
+            job->id = 0;
+            return;
+        }
+    }
+}
+
+static int job_is_done(const job_t *job) {
+    for (int i = 0; i < job->proc_count; i++) {
+        if (job->procs[i].state != PROC_DONE) return 0;
+    }
+    return 1;
+}
+
+static int job_is_stopped(const job_t *job) {
+    int stopped = 0;
+    for (int i = 0; i < job->proc_count; i++) {
+        if (job->procs[i].state == PROC_RUNNING) return 0;
+        if (job->procs[i].state == PROC_STOPPED) stopped = 1;
+    }
+    return stopped;
+}
+
+// Raw wait status -> shell exit status
+static int exit_code(int status) {
+    if (WIFEXITED(status)) return WEXITSTATUS(status);
+    if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+    if (WIFSTOPPED(status)) return 128 + WSTOPSIG(status);
+    return 0;
+}
+
+// Shell exit status of a job: its last process decides, or with pipefail
+// the rightmost process that failed
+static int job_status(const job_t *job) {
+    if (job->proc_count == 0) return 0;
+
+    if (shell_options.pipefail) {
+        for (int i = job->proc_count - 1; i >= 0; i--) {
+            int code = exit_code(job->procs[i].status);
+            if (code != 0) return code;
+        }
+        return 0;
+    }
+    return exit_code(job->procs[job->proc_count - 1].status);
+}
+
+// Per-process results of the last foreground job (PIPESTATUS, time)
+static void record_results(const job_t *job) {
+    if (job->proc_count > last_result_cap) {
+        job_result_t *grown = realloc(last_results, job->proc_count * sizeof(job_result_t));
+        if (!grown) {
+            last_result_count = 0;
+            return;
+        }
+        last_results = grown;
+        last_result_cap = job->proc_count;
+    }
+    for (int i = 0; i < job->proc_count; i++) {
+        last_results[i].status = exit_code(job->procs[i].status);
+        last_results[i].wall = job->procs[i].wall;
+        last_results[i].usage = job->procs[i].usage;
+    }
+    last_result_count = job->proc_count;
+}
+
+// %+ is the most recently stopped/backgrounded job, %- the one before
+static job_t* current_job(int previous) {
+    job_t *best = NULL;
+    job_t *second = NULL;
+
+    for (job_t *job = job_list; job; job = job->next) {
+        if (!best || job->seq > best->seq) {
+            second = best;
+            best = job;
+        } else if (!second || job->seq > second->seq) {
+            second = job;
+        }
+    }
+    return previous ? second : best;
+}
+
+static double seconds_since(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// usage is what wait4 returned, only meaningful once the process is done
+static void update_process(job_process_t *proc, int status, const struct rusage *usage) {
+    proc->status = status;
+    if (WIFSTOPPED(status)) {
+        proc->state = PROC_STOPPED;
+    } else if (WIFCONTINUED(status)) {
+        proc->state = PROC_RUNNING;
+    } else {
+        proc->state = PROC_DONE;
+        proc->usage = *usage;
+        proc->wall = seconds_since(&proc->started);
+    }
+}
+
+static job_process_t* find_process(job_t *job, pid_t pid) {
+    for (int i = 0; i < job->proc_count; i++) {
+        if (job->procs[i].pid == pid) return &job->procs[i];
+    }
+    return NULL;
+}
+
+static void describe_state(const job_t *job, char *buf, size_t size) {
+    if (!job_is_done(job)) {
+        snprintf(buf, size, "%s", job_is_stopped(job) ? "Stopped" : "Running");
+        return;
+    }
+
+    int status = job->procs[job->proc_count - 1].status;
+    if (WIFSIGNALED(status)) {
+        snprintf(buf, size, "%s", strsignal(WTERMSIG(status)));
+    } else if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+        snprintf(buf, size, "Exit %d", WEXITSTATUS(status));
+    } else {
+        snprintf(buf, size, "Done");
+    }
+}
+
+static void print_job(const job_t *job) {
+    char state[64];
+    char marker = ' ';
+
+    if (job == current_job(0)) marker = '+';
+    else if (job == current_job(1)) marker = '-';
+
+    describe_state(job, state, sizeof(state));
+    printf("[%d]%c  %-24s%s\n", job->id, marker, state, job->command);
+}
+
+// =================================================================
+// Launching
+// =================================================================
+
+job_t* job_create(const char *command) {
+    job_t *job = calloc(1, sizeof(job_t));
+    if (!job) return NULL;
+
+    job->command = strdup(command ? command : "");
+    if (!job->command) {
+        free(job);
+        return NULL;
+    }
+    return job;
+}
+
+void job_prepare_launch(const job_t *job, launch_spec_t *spec, int foreground) {
+    if (!job_control || !job) return;
+
+    spec->set_pgroup = 1;
+    spec->pgid = job->pgid;
+    spec->take_terminal = foreground;
+}
+
+void job_enter_group(const job_t *job, int foreground) {
+    if (job_control && job) {
+        setpgid(0, job->pgid);
+        if (foreground) {
+            tcsetpgrp(STDIN_FILENO, getpgrp());
+        }
+    }
+    jobs_enter_child();
+}
+
+static job_process_t* append_process(job_t *job) {
+    if (job->proc_count == job->proc_cap) {
+        int new_cap = job->proc_cap ? job->proc_cap * 2 : 4;
+        job_process_t *grown = realloc(job->procs, new_cap * sizeof(job_process_t));
+        if (!grown) {
+            return NULL;
+        }
+        job->procs = grown;
+        job->proc_cap = new_cap;
+    }
+    return &job->procs[job->proc_count++];
+}
+
+void job_add_process(job_t *job, pid_t pid) {
+    job_process_t *proc = append_process(job);
+    if (!proc) {
+        DEBUG_ERROR("Out of memory tracking PID %d", pid);
+        return;
+    }
+    proc->pid = pid;
+    proc->status = 0;
+    proc->state = PROC_RUNNING;
+    proc->wall = 0;
+    memset(&proc->usage, 0, sizeof(proc->usage));
+    clock_gettime(CLOCK_MONOTONIC, &proc->started);
+
+    if (job_control) {
+        if (!job->pgid) job->pgid = pid;
+        // The child does this too; whichever runs first wins the race
+        setpgid(pid, job->pgid);
+    }
+}
+
+// A stage that never started still has a place (and a status) in the job
+void job_add_result(job_t *job, int status) {
+    job_process_t *proc = append_process(job);
+    if (!proc) return;
+    memset(proc, 0, sizeof(*proc));
+    proc->status = W_EXITCODE(status, 0);
+    proc->state = PROC_DONE;
+}
+
+// Block until every process is done or the job stops
+static void wait_job(job_t *job) {
+    while (!job_is_done(job) && !job_is_stopped(job)) {
+        pid_t target = -1;
+        if (job_control && job->pgid) {
+            target = -job->pgid;
+        } else {
+            for (int i = 0; i < job->proc_count; i++) {
+                if (job->procs[i].state == PROC_RUNNING) {
+                    target = job->procs[i].pid;
+                    break;
+                }
+            }
+        }
+
+        int status;
+        struct rusage usage;
+        pid_t pid = wait4(target, &status, job_control ? WUNTRACED : 0, &usage);
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            // Reaped somewhere else (or never ours): the real status is lost,
+            // so don't pass it off as success
+            DEBUG_WARN("wait for job '%s' failed: %s", job->command, strerror(errno));
+            for (int i = 0; i < job->proc_count; i++) {
+                if (job->procs[i].state != PROC_DONE) {
+                    job->procs[i].state = PROC_DONE;
+                    job->procs[i].status = W_EXITCODE(1, 0);
+                }
+            }
+            break;
+        }
+
+        job_process_t *proc = find_process(job, pid);
+        if (proc) {
+            update_process(proc, status, &usage);
+        }
+    }
+}
+
+// For builtins with their own wait loop (parallel). Once nothing in the
+// job is running its process group is gone, so the next process leads a
+// new one.
+void job_process_reaped(job_t *job, pid_t pid, int status, const struct rusage *usage) {
+    job_process_t *proc = find_process(job, pid);
+    if (!proc) return;
+
+    update_process(proc, status, usage);
+    for (int i = 0; i < job->proc_count; i++) {
+        if (job->procs[i].state == PROC_RUNNING) return;
+    }
+    job->pgid = 0;
+}
+
+int job_run_foreground(job_t *job) {
+    if (job->proc_count == 0) {
+        job_discard(job);
+        return 0;
+    }
+
+    if (job_control && job->pgid) {
+        tcsetpgrp(STDIN_FILENO, job->pgid);
+    }
+
+    wait_job(job);
+    int status = job_status(job);
+    record_results(job);
+
+    if (job_control) {
+        // Take the terminal back, and our modes with it
+        tcsetpgrp(STDIN_FILENO, shell_pgid);
+        if (job_is_stopped(job)) {
+            tcgetattr(STDIN_FILENO, &job->tmodes);
+            job->has_tmodes = 1;
+        }
+        tcsetattr(STDIN_FILENO, TCSADRAIN, &shell_tmodes);
+    }
+
+    if (job_is_stopped(job)) {
+        if (!job->id) insert_job(job);
+        job->seq = ++job_seq;
+        job->notify = 0;
+        printf("\n");
+        print_job(job);
+        return status;
+    }
+
+    // ^C leaves the cursor after the echoed "^C"
+    if (job_control && status == 128 + SIGINT) {
+        printf("\n");
+    }
+
+    remove_job(job);
+    free_job(job);
+    return status;
+}
+
+void job_run_background(job_t *job) {
+    if (job->proc_count == 0) {
+        job_discard(job);
+        return;
+    }
+
+    insert_job(job);
+    job->seq = ++job_seq;
+
+    if (job_control) {
+        printf("[%d] %d\n", job->id, job->procs[job->proc_count - 1].pid);
+    }
+    DEBUG_INFO("Background job %d: %s (%d processes)", job->id, job->command, job->proc_count);
+}
+
+void job_discard(job_t *job) {
+    if (!job) return;
+    remove_job(job);
+    free_job(job);
+}
+
+// =================================================================
+// Reaping, from the main loop
+// =================================================================
+
+void jobs_poll(void) {
+    if (jobs_inherited) return;     // wait4 would say ECHILD: not "Done"
+
+    if (sig_pipe[0] >= 0) {
+        char buf[64];
+        while (read(sig_pipe[0], buf, sizeof(buf)) > 0) {
+            // drain
+        }
+    }
+
+    for (job_t *job = job_list; job; job = job->next) {
+        for (int i = 0; i < job->proc_count; i++) {
+            job_process_t *proc = &job->procs[i];
+            if (proc->state == PROC_DONE) continue;
+
+            int status;
+            struct rusage usage;
+            pid_t pid = wait4(proc->pid, &status, WNOHANG | WUNTRACED | WCONTINUED, &usage);
+            if (pid == proc->pid) {
+                update_process(proc, status, &usage);
+                job->notify = 1;
+            } else if (pid < 0 && errno == ECHILD) {
+                proc->state = PROC_DONE;
+                job->notify = 1;
+            }
+        }
+    }
+}
+
+int jobs_have_news(void) {
+    for (job_t *job = job_list; job; job = job->next) {
+        if (job->notify && (job_is_done(job) || job_is_stopped(job))) return 1;
+    }
+    return 0;
+}
+
+// Report finished/stopped jobs (interactive only) and drop finished ones
+void jobs_notify(void) {
+    job_t *job = job_list;
+
+    while (job) {
+        job_t *next = job->next;
+
+        if (job->notify) {
+            job->notify = 0;
+            if (job_is_done(job)) {
+                if (job_control) print_job(job);
+                remove_job(job);
+                free_job(job);
+            } else if (job_is_stopped(job) && job_control) {
+                print_job(job);
+            }
+        }
+        job = next;
+    }
+    fflush(stdout);
+}
+
+// =================================================================
+// Builtin support
+// =================================================================
+
+job_t* job_find(const char *spec) {
+    if (!spec || strcmp(spec, "%") == 0 || strcmp(spec, "%%") == 0 || strcmp(spec, "%+") == 0) {
+        return current_job(0);
+    }
+    if (strcmp(spec, "%-") == 0) {
+        return current_job(1);
+    }
+
+    if (spec[0] == '%') {
+        if (isdigit((unsigned char)spec[1])) {
+            int id = atoi(spec + 1);
+            for (job_t *job = job_list; job; job = job->next) {
+                if (job->id == id) return job;
+            }
+            return NULL;
+        }
+
+        // %name: the job whose command starts with name
+        size_t len = strlen(spec + 1);
+        for (job_t *job = job_list; job; job = job->next) {
+            if (strncmp(job->command, spec + 1, len) == 0) return job;
+        }
+        return NULL;
+    }
+
+    // Plain pid of any process in a job
+    pid_t pid = (pid_t)atoi(spec);
+    for (job_t *job = job_list; job; job = job->next) {
+        if (find_process(job, pid)) return job;
+    }
+    return NULL;
+}
+
+int job_signal(job_t *job, int sig) {
+    if (job_control && job->pgid) {
+        return kill(-job->pgid, sig);
+    }
+
+    int rc = 0;
+    for (int i = 0; i < job->proc_count; i++) {
+        if (job->procs[i].state != PROC_DONE && kill(job->procs[i].pid, sig) == -1) {
+            rc = -1;
+        }
+    }
+    return rc;
+}
+
+int job_continue(job_t *job, int foreground) {
+    for (int i = 0; i < job->proc_count; i++) {
+        if (job->procs[i].state == PROC_STOPPED) {
+            job->procs[i].state = PROC_RUNNING;
+        }
+    }
+    job->notify = 0;
+    job->seq = ++job_seq;
+
+    if (!foreground) {
+        job_signal(job, SIGCONT);
+        printf("[%d]+ %s &\n", job->id, job->command);
+        return 0;
+    }
+
+    printf("%s\n", job->command);
+    fflush(stdout);
+
+    if (job_control) {
+        tcsetpgrp(STDIN_FILENO, job->pgid);
+        if (job->has_tmodes) {
+            tcsetattr(STDIN_FILENO, TCSADRAIN, &job->tmodes);
+        }
+    }
+    job_signal(job, SIGCONT);
+    return job_run_foreground(job);
+}
+
+int job_wait(job_t *job) {
+    wait_job(job);
+    int status = job_status(job);
+
+    if (job_is_done(job)) {
+        remove_job(job);
+        free_job(job);
+    }
+    return status;
+}
+
+int job_last_results(const job_result_t **results) {
+    *results = last_results;
+    return last_result_count;
+}
+
+void job_forget_results(void) {
+    last_result_count = 0;
+}
+
+// Stopped jobs would never finish, so only running ones are waited for
+int jobs_wait_all(void) {
+    int waited = 1;
+
+    while (waited) {
+        waited = 0;
+        for (job_t *job = job_list; job; job = job->next) {
+            if (!job_is_stopped(job)) {
+                job_wait(job);
+                waited = 1;
+                break;
+            }
+        }
+    }
+    return 0;
+}
+
+void jobs_print(void) {
+    jobs_poll();
+
+    job_t *job = job_list;
+    while (job) {
+        job_t *next = job->next;
+        print_job(job);
+        job->notify = 0;
+        if (job_is_done(job)) {
+            remove_job(job);
+            free_job(job);
+        }
+        job = next;
+    }
+}
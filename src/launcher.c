@@ -0,0 +1,405 @@
+#define _GNU_SOURCE     // posix_spawn_file_actions_addtcsetpgrp_np, pipe2, F_SETPIPE_SZ
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <spawn.h>
+#include "launcher.h"
+#include "pathcache.h"
+#include "variables.h"
+#include "debug.h"
+
+// glibc 2.35+ can hand the terminal to the child inside posix_spawn
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 35))
+#define HAVE_SPAWN_TCSETPGRP 1
+#endif
+
+static launch_mode_t launch_mode = LAUNCH_SPAWN;
+
+// Spawn attributes are built once; flags and process group are set again
+// on every call, so nothing carries over from the previous spawn
+static posix_spawnattr_t spawn_attr;
+static int spawn_attr_ready = 0;
+
+void set_launch_mode(launch_mode_t mode) {
+    launch_mode = mode;
+}
+
+launch_mode_t get_launch_mode(void) {
+    return launch_mode;
+}
+
+int report_launch_failure(const char *cmd) {
+    int err = errno;
+
+    if (err == ENOENT) {
+        fprintf(stderr, "%s: command not found\n", cmd);
+        return 127;
+    }
+
+    fprintf(stderr, "%s: %s\n", cmd, strerror(err));
+    return err == EACCES ? 126 : 1;
+}
+
+// Pipe between two stages. O_CLOEXEC so only the child that dup2's an end
+// onto stdin/stdout keeps it. size > 0 asks for that capacity; the kernel
+// rounds up to pages and refuses more than /proc/sys/fs/pipe-max-size
+// without CAP_SYS_RESOURCE, in which case the default is kept.
+int open_pipe(int fds[2], int size) {
+    if (pipe2(fds, O_CLOEXEC) == -1) {
+        return -1;
+    }
+    if (size > 0 && fcntl(fds[1], F_SETPIPE_SZ, size) == -1) {
+        DEBUG_WARN("Pipe size %d not applied: %s", size, strerror(errno));
+    }
+    return 0;
+}
+
+// Apply redirections for a command
+int apply_redirections(const redirection_t *redirections, int count) {
+    for (int i = 0; i < count; i++) {
+        const redirection_t *redir = &redirections[i];
+        int fd;
+
+        switch (redir->type) {
+            case REDIRECT_OUTPUT:
+                // Open file for writing (create/truncate)
+                fd = open(redir->filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                if (fd == -1) {
+                    perror("Failed to open output file");
+                    return -1;
+                }
+                if (dup2(fd, STDOUT_FILENO) == -1) {
+                    perror("Failed to redirect stdout");
+                    close(fd);
+                    return -1;
+                }
+                close(fd);
+                break;
+
+            case REDIRECT_APPEND:
+                // Open file for appending
+                fd = open(redir->filename, O_WRONLY | O_CREAT | O_APPEND, 0644);
+                if (fd == -1) {
+                    perror("Failed to open append file");
+                    return -1;
+                }
+                if (dup2(fd, STDOUT_FILENO) == -1) {
+                    perror("Failed to redirect stdout for append");
+                    close(fd);
+                    return -1;
+                }
+                close(fd);
+                break;
+
+            case REDIRECT_INPUT:
+                // Open file for reading
+                fd = open(redir->filename, O_RDONLY);
+                if (fd == -1) {
+                    perror("Failed to open input file");
+                    return -1;
+                }
+                if (dup2(fd, STDIN_FILENO) == -1) {
+                    perror("Failed to redirect stdin");
+                    close(fd);
+                    return -1;
+                }
+                close(fd);
+                break;
+
+            case REDIRECT_ERROR:
+                // Open file for error output
+                fd = open(redir->filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                if (fd == -1) {
+                    perror("Failed to open error file");
+                    return -1;
+                }
+                if (dup2(fd, STDERR_FILENO) == -1) {
+                    perror("Failed to redirect stderr");
+                    close(fd);
+                    return -1;
+                }
+                close(fd);
+                break;
+
+            case REDIRECT_BOTH:
+                // Redirect both stdout and stderr to same file
+                fd = open(redir->filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                if (fd == -1) {
+                    perror("Failed to open combined output file");
+                    return -1;
+                }
+                if (dup2(fd, STDOUT_FILENO) == -1) {
+                    perror("Failed to redirect stdout");
+                    close(fd);
+                    return -1;
+                }
+                if (dup2(fd, STDERR_FILENO) == -1) {
+                    perror("Failed to redirect stderr");
+                    close(fd);
+                    return -1;
+                }
+                close(fd);
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    return 0;
+}
+
+static int init_spawn_attr(void) {
+    if (spawn_attr_ready) return 0;
+
+    if (posix_spawnattr_init(&spawn_attr) != 0) return -1;
+
+    // Child starts with every signal at default and nothing blocked,
+    // same as the old signal(i, SIG_DFL) loop but done inside the spawn
+    sigset_t defaults, mask;
+    sigfillset(&defaults);
+    sigdelset(&defaults, SIGKILL);
+    sigdelset(&defaults, SIGSTOP);
+    sigemptyset(&mask);
+
+    if (posix_spawnattr_setsigdefault(&spawn_attr, &defaults) != 0 ||
+        posix_spawnattr_setsigmask(&spawn_attr, &mask) != 0 ||
+        posix_spawnattr_setflags(&spawn_attr,
+                                 POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK) != 0) {
+        posix_spawnattr_destroy(&spawn_attr);
+        return -1;
+    }
+
+    spawn_attr_ready = 1;
+    return 0;
+}
+
+// Translate pipes + redirections into spawn file actions
+static int build_file_actions(const launch_spec_t *spec, posix_spawn_file_actions_t *fa) {
+    if (posix_spawn_file_actions_init(fa) != 0) return -1;
+
+    int rc = 0;
+
+#ifdef HAVE_SPAWN_TCSETPGRP
+    // Before the dup2s, while stdin is still the shell's terminal
+    if (spec->take_terminal)
+        rc |= posix_spawn_file_actions_addtcsetpgrp_np(fa, STDIN_FILENO);
+#endif
+
+    // Pipes first, so explicit redirections override them (cmd > file | next)
+    if (spec->stdin_fd >= 0 && spec->stdin_fd != STDIN_FILENO)
+        rc |= posix_spawn_file_actions_adddup2(fa, spec->stdin_fd, STDIN_FILENO);
+    if (spec->stdout_fd >= 0 && spec->stdout_fd != STDOUT_FILENO)
+        rc |= posix_spawn_file_actions_adddup2(fa, spec->stdout_fd, STDOUT_FILENO);
+
+    for (int i = 0; i < spec->close_count; i++) {
+        if (spec->close_fds[i] > STDERR_FILENO)
+            rc |= posix_spawn_file_actions_addclose(fa, spec->close_fds[i]);
+    }
+
+    for (int i = 0; i < spec->redirect_count; i++) {
+        const redirection_t *redir = &spec->redirections[i];
+
+        switch (redir->type) {
+            case REDIRECT_OUTPUT:
+                rc |= posix_spawn_file_actions_addopen(fa, STDOUT_FILENO, redir->filename,
+                                                       O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                break;
+            case REDIRECT_APPEND:
+                rc |= posix_spawn_file_actions_addopen(fa, STDOUT_FILENO, redir->filename,
+                                                       O_WRONLY | O_CREAT | O_APPEND, 0644);
+                break;
+            case REDIRECT_INPUT:
+                rc |= posix_spawn_file_actions_addopen(fa, STDIN_FILENO, redir->filename,
+                                                       O_RDONLY, 0);
+                break;
+            case REDIRECT_ERROR:
+                rc |= posix_spawn_file_actions_addopen(fa, STDERR_FILENO, redir->filename,
+                                                       O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                break;
+            case REDIRECT_BOTH:
+                rc |= posix_spawn_file_actions_addopen(fa, STDOUT_FILENO, redir->filename,
+                                                       O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                rc |= posix_spawn_file_actions_adddup2(fa, STDOUT_FILENO, STDERR_FILENO);
+                break;
+            default:
+                break;
+        }
+    }
+
+    if (rc != 0) {
+        posix_spawn_file_actions_destroy(fa);
+        return -1;
+    }
+    return 0;
+}
+
+static int count_args(char *const args[]) {
+    int n = 0;
+    while (args[n]) n++;
+    return n;
+}
+
+// A file the kernel won't exec (no #! line) is run as a script, the way
+// execvp did: /bin/sh path args... out holds count_args(args) + 2
+static void script_args(char **out, const char *path, char *const args[]) {
+    out[0] = "/bin/sh";
+    out[1] = (char *)path;
+    for (int i = 1; args[i]; i++) {
+        out[i + 1] = args[i];
+    }
+    out[count_args(args) + 1] = NULL;
+}
+
+// Fallback: full fork, then set up the child by hand
+static pid_t launch_with_fork(const launch_spec_t *spec, const char *path) {
+    pid_t pid = fork();
+
+    if (pid < 0) {
+        return -1;
+    }
+
+    if (pid == 0) {
+        // Child process
+
+        // Job control first: the shell ignores SIGTTOU, so tcsetpgrp works
+        // until the signals are reset below
+        if (spec->set_pgroup) {
+            setpgid(0, spec->pgid);
+            if (spec->take_terminal)
+                tcsetpgrp(STDIN_FILENO, getpgrp());
+        }
+
+        // Reset signals to default
+        for (int i = 1; i < 32; i++) {
+            signal(i, SIG_DFL);
+        }
+
+        if (spec->stdin_fd >= 0 && spec->stdin_fd != STDIN_FILENO) {
+            dup2(spec->stdin_fd, STDIN_FILENO);
+        }
+        if (spec->stdout_fd >= 0 && spec->stdout_fd != STDOUT_FILENO) {
+            dup2(spec->stdout_fd, STDOUT_FILENO);
+        }
+        for (int i = 0; i < spec->close_count; i++) {
+            if (spec->close_fds[i] > STDERR_FILENO)
+                close(spec->close_fds[i]);
+        }
+
+        if (apply_redirections(spec->redirections, spec->redirect_count) == -1) {
+            _exit(1);
+        }
+
+        char **envp = get_environment();
+        execve(path, spec->args, envp);
+        if (errno == ENOEXEC) {
+            char *sh_args[count_args(spec->args) + 2];
+            script_args(sh_args, path, spec->args);
+            execve(sh_args[0], sh_args, envp);
+        }
+        _exit(report_launch_failure(spec->args[0]));
+    }
+
+    return pid;
+}
+
+// Errors open() can give as well as execve(); others (ENOEXEC, E2BIG,
+// ETXTBSY, ...) can only be the exec
+static int spawn_error_ambiguous(int err) {
+    switch (err) {
+        case ENOENT: case EACCES: case ENOTDIR: case ELOOP: case ENAMETOOLONG:
+        case EISDIR: case EROFS: case ENOSPC: case EMFILE: case ENFILE:
+        case EPERM: case ENXIO: case EINTR:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+pid_t launch_process(const launch_spec_t *spec) {
+    if (!spec->args || !spec->args[0]) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // Resolved once through the hash table instead of execvp's PATH walk.
+    // Copied: a revalidation below may free the cache entry.
+    const char *cached = path_cache_lookup(spec->args[0]);
+    if (!cached) {
+        errno = ENOENT;
+        return -1;
+    }
+    char path[PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s", cached) >= (int)sizeof(path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    if (launch_mode == LAUNCH_FORK || init_spawn_attr() != 0) {
+        return launch_with_fork(spec, path);
+    }
+
+#ifndef HAVE_SPAWN_TCSETPGRP
+    if (spec->take_terminal) {
+        return launch_with_fork(spec, path);
+    }
+#endif
+
+    short flags = POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK;
+    if (spec->set_pgroup) {
+        flags |= POSIX_SPAWN_SETPGROUP;
+    }
+    posix_spawnattr_setpgroup(&spawn_attr, spec->set_pgroup ? spec->pgid : 0);
+    posix_spawnattr_setflags(&spawn_attr, flags);
+
+    posix_spawn_file_actions_t fa;
+    if (build_file_actions(spec, &fa) != 0) {
+        DEBUG_WARN("spawn file actions unavailable, falling back to fork");
+        return launch_with_fork(spec, path);
+    }
+
+    pid_t pid;
+    char **envp = get_environment();
+    int err = posix_spawn(&pid, path, &fa, &spawn_attr, spec->args, envp);
+
+    if (err == ENOENT || err == EACCES) {
+        // Binary may have moved since it was hashed
+        const char *fresh = path_cache_revalidate(spec->args[0]);
+        if (!fresh) {
+            posix_spawn_file_actions_destroy(&fa);
+            errno = ENOENT;
+            return -1;
+        }
+        if (strcmp(fresh, path) != 0) {
+            snprintf(path, sizeof(path), "%s", fresh);
+            err = posix_spawn(&pid, path, &fa, &spawn_attr, spec->args, envp);
+        }
+    }
+    if (err == ENOEXEC) {
+        char *sh_args[count_args(spec->args) + 2];
+        script_args(sh_args, path, spec->args);
+        err = posix_spawn(&pid, sh_args[0], &fa, &spawn_attr, sh_args, envp);
+    }
+    posix_spawn_file_actions_destroy(&fa);
+
+    if (err != 0 && spec->redirect_count > 0 && spawn_error_ambiguous(err)) {
+        // The same errno can come from opening a redirect target or from the
+        // exec. Rerun through fork, where each step reports its own error;
+        // the redirections are replayed, so targets are opened (and
+        // truncated) a second time, but nothing was written to them yet.
+        DEBUG_INFO("posix_spawn(%s) failed: %s, retrying with fork", path, strerror(err));
+        return launch_with_fork(spec, path);
+    }
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+
+    DEBUG_VERBOSE("Spawned %s as PID %d", path, pid);
+    return pid;
+}
@@ -12,19 +12,28 @@
 #include "parsers.h"
 #include "executor.h"
 #include "history.h"
-#include <bits/waitflags.h>
-#include <sys/wait.h>
 #include <sched.h>
 #include <utils.h>
 #include <variables.h>
+#include "script.h"
+#include "jobs.h"
+#include "prompt_async.h"
+#include <sys/select.h>
+#include <time.h>
+#include <errno.h>
 
 #define MAX_CMD_LEN 1024
 
+// Scratch memory for the line being parsed/executed, reset after each line
+static arena_t line_arena;
+
 void print_usage(const char *program_name) {
-    printf("Usage: %s [OPTIONS]\n", program_name);
+    printf("Usage: %s [OPTIONS] [-c COMMAND | SCRIPT [ARGS...]]\n", program_name);
     printf("Options:\n");
+    printf("  -c COMMAND           Run COMMAND and exit (no prompt, no history)\n");
     printf("  -d, --debug LEVEL    Set debug level (0-4)\n");
     printf("                       0=NONE, 1=ERROR, 2=WARN, 3=INFO, 4=VERBOSE\n");
+    printf("  -o, --debug-file FILE Write debug output to FILE instead of stderr\n");
     printf("  -v, --verbose        Enable verbose debug output (same as -d 4)\n");
     printf("  -q, --quiet          Disable all debug output (same as -d 0)\n");
     printf("  -h, --help           Show this help message\n");
@@ -32,112 +41,163 @@ void print_usage(const char *program_name) {
     printf("  %s                   # Run normally (no debug)\n", program_name);
     printf("  %s -v                # Run with verbose debug\n", program_name);
     printf("  %s --debug 2         # Run with warnings and errors\n", program_name);
+    printf("  %s -c 'make && ls'   # Run one command line\n", program_name);
+    printf("  %s deploy.nsh        # Run a script file\n", program_name);
+    printf("  cat jobs | %s        # Read commands from a pipe\n", program_name);
 }
 
-// Check if a command is a variable assignment
-int is_assignment(const char *str)
+void cleanup_and_exit(int signo)
 {
-    if (!str)
-        return 0;
+    printf("\n[Shell] Saving history and exiting...\n");
 
-    // Looking for VAR=VALUE pattern
-    char *equals = strchr(str, '=');
-    if (!equals || equals == str)
-        return 0; // No = or starts with = (Should have = atleast)
+    // Save history to file
+    save_history_to_file();
 
-    // Check that everything before = is a valid variable name
-    for (char *p = (char *)str; p < equals; p++)
-    {
-        if (!isalnum(*p) && *p != '_')
-            return 0;
-    }
+    // Cleanup resources
+    cleanup_history();
 
-    return 1;
+    printf("Goodbye!\n");
+    exit(0);
 }
 
-void process_assignment(const char *assignment)
+// Run one input line: parse (or reuse the cached parse), then execute
+// Returns the exit status of the last command that ran
+static int execute_line(char *input)
 {
-    char *copy = strdup(assignment);
-    char *equals = strchr(copy, '=');
-
-    *equals = '\0';
-    char *name = copy;
-    char *value = equals + 1;
+    // Reap finished background jobs (reported here in scripts, silently)
+    jobs_poll();
+    jobs_notify();
 
-    // Remove quotes from value (handles both single and double quotes)
-    char *clean_value = value;
-    int len = strlen(value);
-
-    if (len >= 2 &&
-        ((value[0] == '"' && value[len - 1] == '"') ||
-         (value[0] == '\'' && value[len - 1] == '\'')))
+    parsed_line_t *line = parse_command_line(input);
+    if (!line)
     {
-        // Remove both opening and closing quotes
-        value[len - 1] = '\0';   // Remove closing quote
-        clean_value = value + 1; // Skip opening quote
+        return 2;  // Syntax error, already reported
     }
 
-    // Expand variables in the clean value
-    char *expanded_value = expand_variables(clean_value);
-    set_variable(name, expanded_value, 0);
+    int last_exit_status = execute_ast(line->ast, &line_arena);
 
-    DEBUG_INFO("Set variable %s = '%s'\n", name, expanded_value); 
+    release_command_line(line);
+    arena_reset(&line_arena);  // Drop this line's expansions in one go
+    debug_flush();             // This line's trace, before the next prompt
+    return last_exit_status;
+}
 
-    free(expanded_value);
-    free(copy);
+// readline runs in callback mode so the loop can also watch the SIGCHLD
+// self-pipe and report finished jobs while the prompt is up
+static char *pending_input = NULL;
+static int input_ready = 0;
+
+static void on_readline_input(char *line)
+{
+    pending_input = line;
+    input_ready = 1;
+
+    // Back to cooked mode before the command runs
+    rl_callback_handler_remove();
 }
 
-void cleanup_and_exit(int signo)
+// Report job changes without mangling what the user is typing
+static void report_jobs_at_prompt(void)
 {
-    printf("\n[Shell] Saving history and exiting...\n");
+    jobs_poll();
+    if (!jobs_have_news())
+        return;
 
-    // Save history to file
-    save_history_to_file();
+    rl_clear_visible_line();
+    jobs_notify();
+    rl_forced_update_display();
+}
 
-    // Cleanup resources
-    cleanup_history();
+// A prompt segment arrived from the worker after the prompt was drawn
+static void refresh_prompt(void)
+{
+    if (!async_segments_drain())
+        return;
 
-    printf("Goodbye!\n");
-    exit(0);
+    rl_clear_visible_line();
+    rl_set_prompt(render_prompt());
+    rl_forced_update_display();
 }
 
-void sigchld_handler(int signo)
+// Read one line, reaping jobs while waiting. NULL on EOF.
+static char* read_input_line(const char *prompt)
 {
-    DEBUG_INFO("SIGCHLD handler called\n");
-    fflush(stdout);
+    int sig_fd = job_signal_fd();
+    int async_fd = async_segments_fd();
 
-    int status;
-    pid_t pid;
-    while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+    input_ready = 0;
+    pending_input = NULL;
+    rl_callback_handler_install(prompt, on_readline_input);
+
+    while (!input_ready)
     {
-        DEBUG_VERBOSE("SIGCHLD: Reaped child PID %d\n", pid);
-        fflush(stdout);
-        printf("\n[Job completed] PID: %d\n", pid);
-        printf("%s", get_fancy_prompt());
-        fflush(stdout);
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(STDIN_FILENO, &fds);
+        if (sig_fd >= 0)
+            FD_SET(sig_fd, &fds);
+        if (async_fd >= 0)
+            FD_SET(async_fd, &fds);
+
+        int max_fd = sig_fd > STDIN_FILENO ? sig_fd : STDIN_FILENO;
+        if (async_fd > max_fd)
+            max_fd = async_fd;
+        if (select(max_fd + 1, &fds, NULL, NULL, NULL) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("select");
+            rl_callback_handler_remove();
+            return NULL;
+        }
+
+        if (sig_fd >= 0 && FD_ISSET(sig_fd, &fds))
+            report_jobs_at_prompt();
+
+        if (async_fd >= 0 && FD_ISSET(async_fd, &fds))
+            refresh_prompt();
+
+        if (FD_ISSET(STDIN_FILENO, &fds))
+            rl_callback_read_char();
     }
 
-    DEBUG_INFO("SIGCHLD handler finished\n");
-    fflush(stdout);
+    return pending_input;
+}
+
+// Make script arguments visible as @0, @1, ...
+static void set_positional_args(int argc, char *argv[])
+{
+    char name[16];
+    for (int i = 0; i < argc; i++)
+    {
+        snprintf(name, sizeof(name), "%d", i);
+        set_variable(name, argv[i], 0);
+    }
 }
 
 int main(int argc, char *argv[])
 {   
     int opt;
+    char *command_string = NULL;
     struct option long_options[] = {
         {"debug",   required_argument, 0, 'd'},
+        {"debug-file", required_argument, 0, 'o'},
         {"verbose", no_argument,       0, 'v'},
         {"quiet",   no_argument,       0, 'q'},
         {"help",    no_argument,       0, 'h'},
         {0, 0, 0, 0}
     };
     
-    while ((opt = getopt_long(argc, argv, "d:vqh", long_options, NULL)) != -1) {
+    // '+' stops at the script name so its own options are left alone
+    while ((opt = getopt_long(argc, argv, "+d:o:vqhc:", long_options, NULL)) != -1) {
         switch (opt) {
             case 'd': {
                 int level = atoi(optarg);
                 if (level >= 0 && level <= 4) {
-                    set_debug_level((debug_level_t)level);
+                    if (set_debug_level((debug_level_t)level) != (debug_level_t)level) {
+                        fprintf(stderr, "Debug level %d is compiled out of this build (max %d)\n",
+                                level, NUTSHELL_MAX_DEBUG_LEVEL);
+                    }
                 } else {
                     fprintf(stderr, "Invalid debug level: %d (must be 0-4)\n", level);
                     return 1;
@@ -150,6 +210,15 @@ int main(int argc, char *argv[])
             case 'q':
                 set_debug_level(DEBUG_NONE);
                 break;
+            case 'o':
+                if (debug_set_output(optarg) != 0) {
+                    perror(optarg);
+                    return 1;
+                }
+                break;
+            case 'c':
+                command_string = optarg;
+                break;
             case 'h':
                 print_usage(argv[0]);
                 return 0;
@@ -164,13 +233,46 @@ int main(int argc, char *argv[])
         DEBUG_INFO("Debug level set to: %s", debug_level_to_string(g_debug_level));
     }
     
-    char *input;
     init_variables();
+    arena_init(&line_arena);
+
+    // Non-interactive modes: no readline, prompt, history or job messages
+    if (command_string) {
+        set_positional_args(argc - optind, argv + optind);
+        int status = run_script_string(command_string, execute_line);
+        arena_destroy(&line_arena);
+        clear_parse_cache();
+        cleanup_variables();
+        return status;
+    }
+
+    if (optind < argc) {
+        set_positional_args(argc - optind, argv + optind);
+        int status = run_script_file(argv[optind], execute_line);
+        arena_destroy(&line_arena);
+        clear_parse_cache();
+        cleanup_variables();
+        return status;
+    }
+
+    if (!isatty(STDIN_FILENO)) {
+        int status = run_script_fd(STDIN_FILENO, execute_line);
+        arena_destroy(&line_arena);
+        clear_parse_cache();
+        cleanup_variables();
+        return status;
+    }
+
+    char *input;
     init_history(); // initialize history system
+    init_history_search(); // Ctrl-R uses the indexed search
+
+    // Process groups, terminal ownership and the SIGCHLD self-pipe
+    init_job_control(1);
 
-    // initializing readline lib not needed
+    // User, host and cwd looked up once, not at every prompt
+    init_prompt();
 
-    signal(SIGCHLD, sigchld_handler);
     signal(SIGINT, cleanup_and_exit);  // Ctrl+C
     signal(SIGTERM, cleanup_and_exit); // Termination
     signal(SIGQUIT, cleanup_and_exit); // Quit signal
@@ -179,8 +281,12 @@ int main(int argc, char *argv[])
 
     while (1)
     {
+        // Finished background jobs are reported before the next prompt
+        jobs_poll();
+        jobs_notify();
+
         // readline handles history automatically with up/down arrows
-        input = readline(get_colored_prompt());
+        input = read_input_line(render_prompt());
         DEBUG_VERBOSE("Input received: '%s' (length: %zu)\n", input ? input : "NULL", input ? strlen(input) : 0);
 
         // Check for EOF (Ctrl+D)  
@@ -200,78 +306,19 @@ int main(int argc, char *argv[])
 
         add_history(input);    // readline's built-in history function
         add_to_history(input); // my custom history function
+        save_history_to_file(); // append it now, other sessions see it too
 
-        if (is_assignment(input))
-        {
-            process_assignment(input);
-            free(input);
-            continue;
-        }
-
-        command_list_t cmd_list;
-        parse_command_line(input, &cmd_list);
-
-        // Execute commands, grouping them into pipelines
-     
-       // Execute commands with logical operator support
-int last_exit_status = 0;  // Track the exit status of the last command
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        execute_line(input);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        prompt_command_finished((end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
 
-for (int i = 0; i < cmd_list.count; i++) {
-    command_t *cmd = &cmd_list.commands[i];
-    
-    // Skip empty commands
-    if (cmd->args[0] == NULL) {
-        continue;
+        //  Free the input allocated by readline
+        free(input);
     }
-    
-    // Determine if we should execute this command based on previous result
-    int should_execute = 1;
-    
-    if (i > 0) {
-        // Check the operator from the previous command
-        operator_type_t prev_operator = cmd_list.commands[i-1].next_operator;
-        
-        if (prev_operator == OP_AND) {
-            // && : Execute only if previous command succeeded (exit status 0)
-            should_execute = (last_exit_status == 0);
-            DEBUG_INFO("&& operator: last_status=%d, executing=%s", 
-                      last_exit_status, should_execute ? "yes" : "no");
-        } else if (prev_operator == OP_OR) {
-            // || : Execute only if previous command failed (exit status != 0)
-            should_execute = (last_exit_status != 0);
-            DEBUG_INFO("|| operator: last_status=%d, executing=%s", 
-                      last_exit_status, should_execute ? "yes" : "no");
-        }
-        // For OP_SEMICOLON, OP_PIPE, OP_NONE - always execute (should_execute stays 1)
-    }
-    
-    if (should_execute) {
-        DEBUG_INFO("Executing: %s", cmd->args[0]);
-        
-        // Check if it's a built-in command with your existing logic
-        if (cmd->redirect_count > 0) {
-            // Execute with redirections
-            execute_command_with_redirections(cmd);
-            last_exit_status = 0;  // Assume success for redirected commands
-        } else if (handle_builtin(cmd->args)) {
-            // Built-in command executed
-            last_exit_status = 0;  // Built-ins assume success
-        } else {
-            // Execute external command and capture exit status
-            last_exit_status = execute_external_command_with_status(cmd->args, cmd->is_background);
-        }
-        
-        DEBUG_INFO("Command '%s' exited with status: %d", cmd->args[0], last_exit_status);
-    } else {
-        DEBUG_INFO("Skipping: %s (condition not met)", cmd->args[0]);
-    }
-}
-
-free_command_list(&cmd_list);
-
-//  Free the input allocated by readline
-free(input);
-}
-cleanup_variables();
-return 0;
+    arena_destroy(&line_arena);
+    clear_parse_cache();
+    cleanup_variables();
+    return 0;
 }
\ No newline at end of file
@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "options.h"
+#include "variables.h"
+
+shell_options_t shell_options = {0};
+
+typedef enum {
+    OPTION_FLAG,        // set -o name / set +o name
+    OPTION_SIZE         // set -o name=64K, set +o name back to 0
+} option_kind_t;
+
+typedef struct {
+    const char *name;
+    int *value;
+    option_kind_t kind;
+} option_entry_t;
+
+static const option_entry_t option_table[] = {
+    {"pipefail", &shell_options.pipefail, OPTION_FLAG},
+    {"pipesize", &shell_options.pipe_size, OPTION_SIZE},
+    {"timing", &shell_options.timing, OPTION_FLAG},
+    {NULL, NULL, 0}
+};
+
+// Byte count with an optional K/M suffix. -1 if it isn't one.
+static int parse_size(const char *text) {
+    char *end;
+    long value = strtol(text, &end, 10);
+
+    if (end == text || value < 0) return -1;
+    if (*end == 'k' || *end == 'K') {
+        value *= 1024;
+        end++;
+    } else if (*end == 'm' || *end == 'M') {
+        value *= 1024 * 1024;
+        end++;
+    }
+    if (*end != '\0' || value > INT_MAX) return -1;
+    return (int)value;
+}
+
+int set_shell_option(const char *spec, int on) {
+    const char *equals = strchr(spec, '=');
+    size_t name_len = equals ? (size_t)(equals - spec) : strlen(spec);
+
+    for (int i = 0; option_table[i].name; i++) {
+        const option_entry_t *opt = &option_table[i];
+        if (strlen(opt->name) != name_len || strncmp(spec, opt->name, name_len) != 0) {
+            continue;
+        }
+
+        if (opt->kind == OPTION_FLAG) {
+            if (equals) return -1;
+            *opt->value = on;
+            return 0;
+        }
+
+        // Sizes need a value to turn on; +o resets to the default
+        if (!on) {
+            *opt->value = 0;
+            return 0;
+        }
+        int size = equals ? parse_size(equals + 1) : -1;
+        if (size < 0) return -1;
+        *opt->value = size;
+        return 0;
+    }
+    return -1;
+}
+
+void print_shell_options(void) {
+    for (int i = 0; option_table[i].name; i++) {
+        const option_entry_t *opt = &option_table[i];
+        if (opt->kind == OPTION_FLAG) {
+            printf("%-16s%s\n", opt->name, *opt->value ? "on" : "off");
+        } else if (*opt->value) {
+            printf("%-16s%d\n", opt->name, *opt->value);
+        } else {
+            printf("%-16sdefault\n", opt->name);
+        }
+    }
+}
+
+int shell_pipe_size(void) {
+    if (shell_options.pipe_size) {
+        return shell_options.pipe_size;
+    }
+
+    const char *env = get_variable(PIPE_SIZE_ENV);
+    int size = env ? parse_size(env) : -1;
+    return size > 0 ? size : 0;
+}
@@ -0,0 +1,475 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "parallel.h"
+#include "launcher.h"
+#include "jobs.h"
+#include "variables.h"
+#include "debug.h"
+
+typedef enum {
+    OUTPUT_GROUPED,     // a task's output in one piece when it finishes
+    OUTPUT_ORDERED,     // same, but in input order (-k)
+    OUTPUT_UNGROUPED    // straight to our stdout as it's written (-u)
+} output_mode_t;
+
+typedef enum {
+    TASK_PENDING,
+    TASK_RUNNING,
+    TASK_DONE,
+    TASK_SKIPPED        // never started, fail-fast stopped the run
+} task_state_t;
+
+typedef struct {
+    const char *input;
+    pid_t pid;
+    int out_fd;             // read end of its stdout pipe, -1 when closed/unused
+    int reaped;
+    char *output;
+    size_t output_len;
+    size_t output_cap;
+    int status;
+    task_state_t state;
+} task_t;
+
+typedef struct {
+    int max_running;
+    output_mode_t mode;
+    int fail_fast;
+    char **command;         // template, {} replaced by the input
+    int command_argc;
+    task_t *tasks;
+    int task_count;
+    int next_launch;
+    int next_print;
+    int running;            // started and not reaped yet
+    int halted;             // launch nothing more
+    int stdin_fd;           // what tasks read, -1 to share ours
+    job_t *job;             // process group and terminal, results for time
+} parallel_t;
+
+static int usage(void) {
+    fprintf(stderr, "Usage: parallel [-j N] [-k | -u] [-f] command [args] [::: input ...]\n");
+    return 1;
+}
+
+static int write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Inputs one per line from stdin (like xargs -L1), blank lines skipped.
+// Returns 0, or -1 (reported, nothing left allocated) when out of memory.
+static int read_input_lines(char ***out, int *count) {
+    char **lines = NULL;
+    int cap = 0;
+    char *line = NULL;
+    size_t line_cap = 0;
+    ssize_t len;
+
+    *count = 0;
+    while ((len = getline(&line, &line_cap, stdin)) != -1) {
+        if (len > 0 && line[len - 1] == '\n') line[--len] = '\0';
+        if (len == 0) continue;
+
+        if (*count == cap) {
+            cap = cap ? cap * 2 : 64;
+            char **grown = realloc(lines, cap * sizeof(char *));
+            if (!grown) goto oom;
+            lines = grown;
+        }
+        if (!(lines[*count] = strdup(line))) goto oom;
+        (*count)++;
+    }
+    free(line);
+    *out = lines;
+    return 0;
+
+oom:
+    fprintf(stderr, "parallel: out of memory reading inputs\n");
+    for (int i = 0; i < *count; i++) free(lines[i]);
+    free(lines);
+    free(line);
+    *count = 0;
+    return -1;
+}
+
+// "{}" anywhere in a word becomes the input
+static char* substitute(const char *word, const char *input) {
+    size_t input_len = strlen(input);
+    size_t len = strlen(word);
+    size_t count = 0;
+
+    for (const char *p = word; (p = strstr(p, "{}")) != NULL; p += 2) count++;
+
+    char *result = malloc(len + count * input_len - count * 2 + 1);
+    if (!result) return NULL;
+
+    char *out = result;
+    const char *in = word;
+    const char *hit;
+    while ((hit = strstr(in, "{}")) != NULL) {
+        memcpy(out, in, hit - in);
+        out += hit - in;
+        memcpy(out, input, input_len);
+        out += input_len;
+        in = hit + 2;
+    }
+    strcpy(out, in);
+    return result;
+}
+
+static void free_argv(char **argv) {
+    for (int i = 0; argv[i]; i++) free(argv[i]);
+    free(argv);
+}
+
+// argv for one task; the input goes last if no word has {}
+static char** build_argv(const parallel_t *par, const char *input) {
+    char **argv = calloc(par->command_argc + 2, sizeof(char *));
+    if (!argv) return NULL;
+
+    int placed = 0;
+    int i;
+    for (i = 0; i < par->command_argc; i++) {
+        if (strstr(par->command[i], "{}")) {
+            argv[i] = substitute(par->command[i], input);
+            placed = 1;
+        } else {
+            argv[i] = strdup(par->command[i]);
+        }
+        if (!argv[i]) break;
+    }
+    if (i == par->command_argc && !placed && !(argv[i] = strdup(input))) {
+        i = -1;
+    }
+
+    // A NULL in the middle would silently run a shorter command
+    if (i < par->command_argc) {
+        free_argv(argv);
+        errno = ENOMEM;
+        return NULL;
+    }
+    return argv;
+}
+
+static void task_finished(parallel_t *par, task_t *task) {
+    if (task->status == 0 || par->halted) return;
+
+    // Ctrl+C always stops the run; other failures only with -f
+    if (par->fail_fast || task->status == 128 + SIGINT) {
+        par->halted = 1;
+        job_signal(par->job, SIGTERM);
+    }
+}
+
+static void launch_task(parallel_t *par, task_t *task) {
+    char **argv = build_argv(par, task->input);
+    int fds[2] = {-1, -1};
+
+    if (!argv || (par->mode != OUTPUT_UNGROUPED && open_pipe(fds, 0) == -1)) {
+        fprintf(stderr, "parallel: %s\n", strerror(errno ? errno : ENOMEM));
+        if (argv) free_argv(argv);
+        task->status = 1;
+        task->state = TASK_DONE;
+        job_add_result(par->job, task->status);
+        task_finished(par, task);
+        return;
+    }
+
+    launch_spec_t spec = {
+        .args = argv,
+        .stdin_fd = par->stdin_fd,
+        .stdout_fd = fds[1],
+    };
+    job_prepare_launch(par->job, &spec, 1);
+
+    pid_t pid = launch_process(&spec);
+    if (fds[1] >= 0) close(fds[1]);
+
+    if (pid < 0) {
+        task->status = report_launch_failure(argv[0]);
+        task->state = TASK_DONE;
+        if (fds[0] >= 0) close(fds[0]);
+        job_add_result(par->job, task->status);
+        task_finished(par, task);
+    } else {
+        task->pid = pid;
+        task->out_fd = fds[0];
+        task->state = TASK_RUNNING;
+        job_add_process(par->job, pid);
+        par->running++;
+    }
+    free_argv(argv);
+}
+
+// Drain whatever a task wrote; close on EOF
+static void read_output(task_t *task) {
+    if (task->output_cap - task->output_len < PARALLEL_READ_CHUNK) {
+        size_t cap = task->output_cap ? task->output_cap * 2 : PARALLEL_READ_CHUNK * 2;
+        char *grown = realloc(task->output, cap);
+        if (!grown) {
+            close(task->out_fd);
+            task->out_fd = -1;
+            return;
+        }
+        task->output = grown;
+        task->output_cap = cap;
+    }
+
+    ssize_t n = read(task->out_fd, task->output + task->output_len, PARALLEL_READ_CHUNK);
+    if (n > 0) {
+        task->output_len += n;
+    } else if (n == 0 || errno != EINTR) {
+        close(task->out_fd);
+        task->out_fd = -1;
+    }
+}
+
+static void reap_tasks(parallel_t *par) {
+    for (int i = 0; i < par->next_launch; i++) {
+        task_t *task = &par->tasks[i];
+        if (task->state != TASK_RUNNING || task->reaped) continue;
+
+        int status;
+        struct rusage usage;
+        pid_t pid = wait4(task->pid, &status, WNOHANG | WUNTRACED, &usage);
+        if (pid != task->pid) continue;
+
+        if (WIFSTOPPED(status)) {
+            kill(task->pid, SIGCONT);   // a run can't be suspended halfway
+            continue;
+        }
+
+        job_process_reaped(par->job, pid, status, &usage);
+        task->reaped = 1;
+        task->status = WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+        par->running--;
+        task_finished(par, task);
+    }
+
+    for (int i = 0; i < par->next_launch; i++) {
+        task_t *task = &par->tasks[i];
+        if (task->state == TASK_RUNNING && task->reaped && task->out_fd < 0) {
+            task->state = TASK_DONE;
+        }
+    }
+}
+
+static void print_task(task_t *task) {
+    if (task->output_len > 0) {
+        write_all(STDOUT_FILENO, task->output, task->output_len);
+    }
+    free(task->output);
+    task->output = NULL;
+    task->output_len = task->output_cap = 0;
+}
+
+// Grouped: every finished task. Ordered: finished tasks up to the first
+// one still running.
+static void print_finished(parallel_t *par) {
+    if (par->mode == OUTPUT_UNGROUPED) return;
+
+    if (par->mode == OUTPUT_ORDERED) {
+        while (par->next_print < par->task_count &&
+               par->tasks[par->next_print].state >= TASK_DONE) {     // or skipped
+            print_task(&par->tasks[par->next_print++]);
+        }
+        return;
+    }
+
+    for (int i = 0; i < par->next_launch; i++) {
+        if (par->tasks[i].state == TASK_DONE && par->tasks[i].output) {
+            print_task(&par->tasks[i]);
+        }
+    }
+}
+
+// Sleep until a task writes, closes its output or (with a SIGCHLD
+// self-pipe) exits. Without the self-pipe, exits are polled for.
+static void wait_for_activity(parallel_t *par, struct pollfd *fds) {
+    int sig_fd = job_signal_fd();
+    int nfds = 0;
+    int unreaped = 0;
+
+    for (int i = 0; i < par->next_launch; i++) {
+        task_t *task = &par->tasks[i];
+        if (task->state != TASK_RUNNING) continue;
+        if (!task->reaped) unreaped = 1;
+        if (task->out_fd >= 0) {
+            fds[nfds].fd = task->out_fd;
+            fds[nfds].events = POLLIN;
+            nfds++;
+        }
+    }
+    if (sig_fd >= 0) {
+        fds[nfds].fd = sig_fd;
+        fds[nfds].events = POLLIN;
+        nfds++;
+    }
+
+    int timeout = (unreaped && sig_fd < 0) ? PARALLEL_POLL_MS : -1;
+    if (poll(fds, nfds, timeout) <= 0) return;
+
+    for (int i = 0; i < nfds; i++) {
+        if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+
+        if (fds[i].fd == sig_fd) {
+            char buf[64];
+            while (read(sig_fd, buf, sizeof(buf)) > 0) {
+                // drain; reap_tasks looks at every task anyway
+            }
+            continue;
+        }
+        for (int j = 0; j < par->next_launch; j++) {
+            if (par->tasks[j].out_fd == fds[i].fd) {
+                read_output(&par->tasks[j]);
+                break;
+            }
+        }
+    }
+}
+
+// PARALLEL_STATUS: every task's status in input order, - if never run
+static void publish_statuses(const parallel_t *par) {
+    size_t cap = (size_t)par->task_count * 4 + 1;
+    char *text = malloc(cap);
+    if (!text) return;
+
+    size_t len = 0;
+    text[0] = '\0';
+    for (int i = 0; i < par->task_count; i++) {
+        const task_t *task = &par->tasks[i];
+        if (task->state == TASK_SKIPPED) {
+            len += snprintf(text + len, cap - len, i ? " -" : "-");
+        } else {
+            len += snprintf(text + len, cap - len, i ? " %d" : "%d", task->status);
+        }
+    }
+    set_variable("PARALLEL_STATUS", text, 0);
+    free(text);
+}
+
+int builtin_parallel(char **args) {
+    parallel_t par;
+    memset(&par, 0, sizeof(par));
+    par.mode = OUTPUT_GROUPED;
+    par.stdin_fd = -1;
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    par.max_running = cores > 0 ? (int)cores : 1;
+
+    int i = 1;
+    for (; args[i] && args[i][0] == '-'; i++) {
+        if (strcmp(args[i], "--") == 0) {
+            i++;
+            break;
+        } else if (strcmp(args[i], "-k") == 0) {
+            par.mode = OUTPUT_ORDERED;
+        } else if (strcmp(args[i], "-u") == 0) {
+            par.mode = OUTPUT_UNGROUPED;
+        } else if (strcmp(args[i], "-f") == 0) {
+            par.fail_fast = 1;
+        } else if (strncmp(args[i], "-j", 2) == 0) {
+            const char *value = args[i][2] ? args[i] + 2 : args[++i];
+            if (!value || atoi(value) <= 0) return usage();
+            par.max_running = atoi(value);
+        } else {
+            return usage();
+        }
+    }
+
+    par.command = &args[i];
+    while (args[i] && strcmp(args[i], ":::") != 0) i++;
+    par.command_argc = (int)(&args[i] - par.command);
+    if (par.command_argc == 0) return usage();
+
+    // Inputs after :::, or lines from stdin (tasks then get /dev/null)
+    char **inputs;
+    char **owned_inputs = NULL;
+    if (args[i]) {
+        inputs = &args[i + 1];
+        while (inputs[par.task_count]) par.task_count++;
+    } else {
+        if (read_input_lines(&owned_inputs, &par.task_count) != 0) {
+            return 1;
+        }
+        inputs = owned_inputs;
+        par.stdin_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    }
+
+    par.tasks = calloc(par.task_count ? par.task_count : 1, sizeof(task_t));
+    struct pollfd *fds = calloc(par.task_count + 1, sizeof(struct pollfd));
+    par.job = job_create(par.command[0]);
+    if (!par.tasks || !fds || !par.job) {
+        fprintf(stderr, "parallel: out of memory\n");
+        free(par.tasks);
+        free(fds);
+        job_discard(par.job);
+        if (par.stdin_fd >= 0) close(par.stdin_fd);
+        for (int j = 0; owned_inputs && j < par.task_count; j++) free(owned_inputs[j]);
+        free(owned_inputs);
+        return 1;
+    }
+
+    for (int j = 0; j < par.task_count; j++) {
+        par.tasks[j].input = inputs[j] ? inputs[j] : "";
+        par.tasks[j].out_fd = -1;
+    }
+
+    fflush(stdout);
+    DEBUG_INFO("parallel: %d tasks, %d at a time", par.task_count, par.max_running);
+
+    while (1) {
+        while (!par.halted && par.running < par.max_running && par.next_launch < par.task_count) {
+            launch_task(&par, &par.tasks[par.next_launch++]);
+        }
+        reap_tasks(&par);
+        print_finished(&par);
+
+        int busy = 0;
+        for (int j = 0; j < par.next_launch; j++) {
+            if (par.tasks[j].state == TASK_RUNNING) busy = 1;
+        }
+        if (!busy && (par.halted || par.next_launch == par.task_count)) break;
+        if (busy) wait_for_activity(&par, fds);
+    }
+
+    for (int j = par.next_launch; j < par.task_count; j++) {
+        par.tasks[j].state = TASK_SKIPPED;
+    }
+    print_finished(&par);
+
+    // Terminal back to the shell; results stay for time and PIPESTATUS
+    job_run_foreground(par.job);
+
+    // Our status: the first failure in input order
+    int status = 0;
+    for (int j = 0; j < par.task_count && !status; j++) {
+        if (par.tasks[j].state == TASK_DONE) status = par.tasks[j].status;
+    }
+    publish_statuses(&par);
+
+    for (int j = 0; j < par.task_count; j++) free(par.tasks[j].output);
+    free(par.tasks);
+    free(fds);
+    if (par.stdin_fd >= 0) close(par.stdin_fd);
+    for (int j = 0; owned_inputs && j < par.task_count; j++) free(owned_inputs[j]);
+    free(owned_inputs);
+    return status;
+}
@@ -3,324 +3,800 @@
 #include <string.h>
 #include <ctype.h>
 #include "parsers.h"
+#include "tokenizer.h"
 #include <unistd.h>
 #include "variables.h"
 #include "debug.h"
+#include "trace.h"
 
-typedef enum
+// Recursive descent state
+typedef struct
+{
+    token_t *tokens;
+    int pos;
+    arena_t *arena;
+    int failed;
+} parser_t;
+
+// LRU cache of parsed lines
+static parsed_line_t *cache_buckets[PARSE_CACHE_BUCKETS];
+static parsed_line_t *lru_head = NULL;   // most recently used
+static parsed_line_t *lru_tail = NULL;   // eviction candidate
+static int cache_count = 0;
+static unsigned long cache_hits = 0;
+static unsigned long cache_misses = 0;
+
+// =================================================================
+// Words
+// =================================================================
+
+// Copy a word without its quote characters
+static size_t remove_quotes(const char *src, size_t len, char *dst)
 {
-    TOKEN_WORD,
-    TOKEN_PIPE,            // |
-    TOKEN_BACKGROUND,      // &
-    TOKEN_SEMICOLON,       // ;
-    TOKEN_REDIRECT_OUT,    // >
-    TOKEN_REDIRECT_APPEND, // >>
-    TOKEN_REDIRECT_IN,     // <
-    TOKEN_REDIRECT_ERR,    // 2>
-    TOKEN_REDIRECT_BOTH,   // &>
-    TOKEN_AND,             // &&  NEW
-    TOKEN_OR,              // ||  NEW
-    TOKEN_EOF
-} token_type_t;
+    size_t out = 0;
+    const char *end = src + len;
 
-typedef struct
+    while (src < end)
+    {
+        if (*src == '"' || *src == '\'')
+        {
+            const char *close = memchr(src + 1, *src, end - src - 1);
+            if (close)
+            {
+                memcpy(dst + out, src + 1, close - src - 1);
+                out += close - src - 1;
+                src = close + 1;
+                continue;
+            }
+        }
+        dst[out++] = *src++;
+    }
+
+    dst[out] = '\0';
+    return out;
+}
+
+static int make_word(parser_t *p, const token_t *tok, word_t *word)
 {
-    token_type_t type;
-    char *value;
-} token_t;
+    int flags = 0;
+    const char *s = tok->start;
+    const char *end = s + tok->len;
+
+    while (s < end)
+    {
+        if (*s == '"' || *s == '\'')
+        {
+            const char *close = memchr(s + 1, *s, end - s - 1);
+            if (close)
+            {
+                flags |= WORD_QUOTED;
+                // Single quotes suppress expansion, double quotes don't
+                if (*s == '"' && memchr(s + 1, '@', close - s - 1))
+                    flags |= WORD_EXPAND;
+                s = close + 1;
+                continue;
+            }
+        }
+        if (*s == '@')
+            flags |= WORD_EXPAND;
+        s++;
+    }
 
-// Enhanced tokenizer with redirection support
-static token_t *tokenize(char *input, int *token_count)
+    word->flags = flags;
+    if (flags & WORD_EXPAND)
+    {
+        // Keep the raw text, the expansion pass needs the quotes
+        word->text = arena_strndup(p->arena, tok->start, tok->len);
+    }
+    else
+    {
+        // Pure literal: do the quote removal once, here
+        word->text = arena_alloc(p->arena, tok->len + 1);
+        if (word->text)
+            remove_quotes(tok->start, tok->len, word->text);
+    }
+
+    return word->text ? 0 : -1;
+}
+
+// =================================================================
+// Recursive descent parser
+// =================================================================
+
+static ast_node_t *parse_list(parser_t *p);
+
+static token_type_t peek(parser_t *p)
 {
-    static token_t tokens[256];
-    *token_count = 0;
+    return p->tokens[p->pos].type;
+}
 
-    char *pos = input;
+static void syntax_error(parser_t *p)
+{
+    if (p->failed)
+        return;
+    p->failed = 1;
+
+    token_t *tok = &p->tokens[p->pos];
+    if (tok->type == TOKEN_EOF)
+        fprintf(stderr, "nutshell: syntax error: unexpected end of line\n");
+    else
+        fprintf(stderr, "nutshell: syntax error near unexpected token '%.*s'\n",
+                (int)tok->len, tok->start);
+}
 
-    while (*pos && *token_count < 255)
+static ast_node_t *new_node(parser_t *p, node_type_t type)
+{
+    ast_node_t *node = arena_alloc(p->arena, sizeof(ast_node_t));
+    if (!node)
     {
-        // Skip whitespace
-        while (isspace(*pos))
-            pos++;
-        if (!*pos)
-            break;
+        p->failed = 1;
+        return NULL;
+    }
+    memset(node, 0, sizeof(*node));
+    node->type = type;
+    return node;
+}
 
-        token_t *token = &tokens[*token_count];
+// Grow-by-doubling array inside the arena (old copies are just abandoned)
+static void *grow_array(parser_t *p, void *items, int count, int *cap, size_t elem)
+{
+    if (count < *cap)
+        return items;
 
-        // Check for redirection operators (order matters! very important )
-        if (*pos == '&' && *(pos + 1) == '&')
-        {
-            token->type = TOKEN_AND;
-            token->value = strdup("&&");
-            pos += 2;
-        }
-        else if (*pos == '|' && *(pos + 1) == '|')
-        {
-            token->type = TOKEN_OR;
-            token->value = strdup("||");
-            pos += 2;
-        }
-        else if (*pos == '>' && *(pos + 1) == '>')
+    int new_cap = *cap ? *cap * 2 : 4;
+    void *grown = arena_alloc(p->arena, new_cap * elem);
+    if (!grown)
+    {
+        p->failed = 1;
+        return NULL;
+    }
+    if (count)
+        memcpy(grown, items, count * elem);
+    *cap = new_cap;
+    return grown;
+}
+
+static redirect_type_t redirect_for(token_type_t type)
+{
+    switch (type)
+    {
+    case TOKEN_REDIRECT_OUT:
+        return REDIRECT_OUTPUT;
+    case TOKEN_REDIRECT_APPEND:
+        return REDIRECT_APPEND;
+    case TOKEN_REDIRECT_IN:
+        return REDIRECT_INPUT;
+    case TOKEN_REDIRECT_ERR:
+        return REDIRECT_ERROR;
+    case TOKEN_REDIRECT_BOTH:
+        return REDIRECT_BOTH;
+    default:
+        return REDIRECT_NONE;
+    }
+}
+
+// redir := ('>' | '>>' | '<' | '2>' | '&>') WORD
+static int parse_redirection(parser_t *p, ast_node_t *node, int *cap)
+{
+    redirect_type_t type = redirect_for(peek(p));
+    p->pos++;
+
+    if (peek(p) != TOKEN_WORD)
+    {
+        DEBUG_ERROR("Expected filename after redirection");
+        syntax_error(p);
+        return -1;
+    }
+
+    node->redirections = grow_array(p, node->redirections, node->redirect_count,
+                                    cap, sizeof(redir_node_t));
+    if (!node->redirections)
+        return -1;
+
+    redir_node_t *redir = &node->redirections[node->redirect_count];
+    redir->type = type;
+    if (make_word(p, &p->tokens[p->pos], &redir->target) != 0)
+        return -1;
+
+    node->redirect_count++;
+    p->pos++;
+    return 0;
+}
+
+// command := '(' list ')' redir* | (WORD | redir)+
+static ast_node_t *parse_command(parser_t *p)
+{
+    int redir_cap = 0;
+
+    if (peek(p) == TOKEN_LPAREN)
+    {
+        p->pos++;
+        ast_node_t *node = new_node(p, NODE_SUBSHELL);
+        if (!node)
+            return NULL;
+
+        ast_node_t *body = parse_list(p);
+        if (!body)
+            return NULL;
+        if (peek(p) != TOKEN_RPAREN)
         {
-            token->type = TOKEN_REDIRECT_APPEND;
-            token->value = strdup(">>");
-            pos += 2;
+            syntax_error(p);
+            return NULL;
         }
-        else if (*pos == '&' && *(pos + 1) == '>')
+        p->pos++;
+
+        node->children = arena_alloc(p->arena, sizeof(ast_node_t *));
+        if (!node->children)
+            return NULL;
+        node->children[0] = body;
+        node->count = 1;
+
+        while (redirect_for(peek(p)) != REDIRECT_NONE)
         {
-            token->type = TOKEN_REDIRECT_BOTH;
-            token->value = strdup("&>");
-            pos += 2;
+            if (parse_redirection(p, node, &redir_cap) != 0)
+                return NULL;
         }
-        else if (*pos == '2' && *(pos + 1) == '>')
+        return node;
+    }
+
+    ast_node_t *node = new_node(p, NODE_COMMAND);
+    if (!node)
+        return NULL;
+    int word_cap = 0;
+
+    while (1)
+    {
+        if (peek(p) == TOKEN_WORD)
         {
-            token->type = TOKEN_REDIRECT_ERR;
-            token->value = strdup("2>");
-            pos += 2;
+            node->words = grow_array(p, node->words, node->count, &word_cap, sizeof(word_t));
+            if (!node->words)
+                return NULL;
+            if (make_word(p, &p->tokens[p->pos], &node->words[node->count]) != 0)
+                return NULL;
+            node->count++;
+            p->pos++;
         }
-        else if (*pos == '>')
+        else if (redirect_for(peek(p)) != REDIRECT_NONE)
         {
-            token->type = TOKEN_REDIRECT_OUT;
-            token->value = strdup(">");
-            pos++;
+            if (parse_redirection(p, node, &redir_cap) != 0)
+                return NULL;
         }
-        else if (*pos == '<')
+        else
         {
-            token->type = TOKEN_REDIRECT_IN;
-            token->value = strdup("<");
-            pos++;
+            break;
         }
-        else if (*pos == '|')
+    }
+
+    if (node->count == 0)
+    {
+        syntax_error(p);
+        return NULL;
+    }
+    return node;
+}
+
+// `time` is a keyword only as the first word, and only with a command after it.
+// Like bash it times one pipeline: `time a && b` measures a alone.
+static int is_time_keyword(parser_t *p)
+{
+    if (peek(p) != TOKEN_WORD)
+        return 0;   // a word is always followed by at least TOKEN_EOF
+
+    const token_t *tok = &p->tokens[p->pos];
+    token_type_t next = p->tokens[p->pos + 1].type;
+    return tok->len == 4 && memcmp(tok->start, "time", 4) == 0 &&
+           (next == TOKEN_WORD || next == TOKEN_LPAREN);
+}
+
+// pipeline := ['time'] command ('|' command)*
+static ast_node_t *parse_pipeline(parser_t *p)
+{
+    int timed = is_time_keyword(p);
+    if (timed)
+        p->pos++;
+
+    ast_node_t *first = parse_command(p);
+    if (!first || peek(p) != TOKEN_PIPE)
+    {
+        if (first)
+            first->timed = timed;
+        return first;
+    }
+
+    ast_node_t *node = new_node(p, NODE_PIPELINE);
+    if (!node)
+        return NULL;
+    node->timed = timed;
+    int cap = 0;
+
+    node->children = grow_array(p, NULL, 0, &cap, sizeof(ast_node_t *));
+    if (!node->children)
+        return NULL;
+    node->children[node->count++] = first;
+
+    while (peek(p) == TOKEN_PIPE)
+    {
+        p->pos++;
+        ast_node_t *stage = parse_command(p);
+        if (!stage)
+            return NULL;
+
+        node->children = grow_array(p, node->children, node->count, &cap, sizeof(ast_node_t *));
+        if (!node->children)
+            return NULL;
+        node->children[node->count++] = stage;
+    }
+
+    return node;
+}
+
+// and_or := pipeline (('&&' | '||') pipeline)*   (left associative)
+static ast_node_t *parse_and_or(parser_t *p)
+{
+    ast_node_t *left = parse_pipeline(p);
+
+    while (left && (peek(p) == TOKEN_AND || peek(p) == TOKEN_OR))
+    {
+        node_type_t type = peek(p) == TOKEN_AND ? NODE_AND : NODE_OR;
+        DEBUG_VERBOSE("Found %s operator", type == NODE_AND ? "&&" : "||");
+        p->pos++;
+
+        ast_node_t *right = parse_pipeline(p);
+        if (!right)
+            return NULL;
+
+        ast_node_t *node = new_node(p, type);
+        if (!node)
+            return NULL;
+        node->children = arena_alloc(p->arena, 2 * sizeof(ast_node_t *));
+        if (!node->children)
+            return NULL;
+        node->children[0] = left;
+        node->children[1] = right;
+        node->count = 2;
+        left = node;
+    }
+
+    return left;
+}
+
+// list := and_or ((';' | '&') and_or)* [';' | '&']
+static ast_node_t *parse_list(parser_t *p)
+{
+    ast_node_t **items = NULL;
+    int count = 0;
+    int cap = 0;
+
+    while (peek(p) != TOKEN_EOF && peek(p) != TOKEN_RPAREN)
+    {
+        ast_node_t *item = parse_and_or(p);
+        if (!item)
+            return NULL;
+
+        if (peek(p) == TOKEN_BACKGROUND)
         {
-            token->type = TOKEN_PIPE;
-            token->value = strdup("|");
-            pos++;
+            item->background = 1;
+            p->pos++;
         }
-        else if (*pos == '&')
+        else if (peek(p) == TOKEN_SEMICOLON)
         {
-            token->type = TOKEN_BACKGROUND;
-            token->value = strdup("&");
-            pos++;
+            p->pos++;
         }
-        else if (*pos == ';')
+        else if (peek(p) != TOKEN_EOF && peek(p) != TOKEN_RPAREN)
         {
-            token->type = TOKEN_SEMICOLON;
-            token->value = strdup(";");
-            pos++;
+            syntax_error(p);
+            return NULL;
         }
-        else if (*pos == '"' || *pos == '\'')
-        {
-            // Handle quoted strings (was having issue due to this)
-            char quote_char = *pos;
-            pos++;
-            char *start = pos;
 
-            while (*pos && *pos != quote_char)
-                pos++;
+        items = grow_array(p, items, count, &cap, sizeof(ast_node_t *));
+        if (!items)
+            return NULL;
+        items[count++] = item;
+    }
 
-            if (*pos == quote_char)
-            {
-                int len = pos - start;
-                token->type = TOKEN_WORD;
-                token->value = malloc(len + 1);
-                strncpy(token->value, start, len);
-                token->value[len] = '\0';
-                pos++;
-            }
-            else
-            {
-                // Handle unclosed quote as regular word
-                pos = start - 1;
-                char *word_start = pos;
-                while (*pos && !isspace(*pos) && *pos != '&' && *pos != ';' &&
-                       *pos != '|' && *pos != '>' && *pos != '<')
-                {
-                    pos++;
-                }
-                int len = pos - word_start;
-                token->type = TOKEN_WORD;
-                token->value = malloc(len + 1);
-                strncpy(token->value, word_start, len);
-                token->value[len] = '\0';
-            }
-        }
-        else
-        {
-            // Regular word token
-            token->type = TOKEN_WORD;
-            char *start = pos;
-            while (*pos && !isspace(*pos) && *pos != '&' && *pos != ';' &&
-                   *pos != '|' && *pos != '>' && *pos != '<')
-            {
-                pos++;
-            }
+    if (count == 0)
+    {
+        syntax_error(p);
+        return NULL;
+    }
 
-            int len = pos - start;
-            token->value = malloc(len + 1);
-            strncpy(token->value, start, len);
-            token->value[len] = '\0';
-        }
+    // Don't wrap a lone foreground item
+    if (count == 1 && !items[0]->background)
+        return items[0];
 
-        (*token_count)++;
+    ast_node_t *node = new_node(p, NODE_LIST);
+    if (!node)
+        return NULL;
+    node->children = items;
+    node->count = count;
+    return node;
+}
+
+// =================================================================
+// Parse cache
+// =================================================================
+
+static size_t hash_line(const char *str)
+{
+    size_t hash = 5381;
+    int c;
+
+    while ((c = *str++))
+    {
+        hash = ((hash << 5) + hash) + c; // hash * 33 + c
     }
 
-    // EOF token
-    tokens[*token_count].type = TOKEN_EOF;
-    tokens[*token_count].value = NULL;
-    (*token_count)++;
+    return hash;
+}
+
+static void lru_unlink(parsed_line_t *line)
+{
+    if (line->lru_prev)
+        line->lru_prev->lru_next = line->lru_next;
+    else
+        lru_head = line->lru_next;
 
-    return tokens;
+    if (line->lru_next)
+        line->lru_next->lru_prev = line->lru_prev;
+    else
+        lru_tail = line->lru_prev;
+
+    line->lru_prev = line->lru_next = NULL;
 }
 
-void parse_command_line(char *input, command_list_t *cmd_list)
+static void lru_push_front(parsed_line_t *line)
 {
-    cmd_list->count = 0;
-    int token_count;
+    line->lru_prev = NULL;
+    line->lru_next = lru_head;
+    if (lru_head)
+        lru_head->lru_prev = line;
+    lru_head = line;
+    if (!lru_tail)
+        lru_tail = line;
+}
 
-    char *expanded_input = expand_variables(input);
-    token_t *tokens = tokenize(expanded_input, &token_count);
+static void free_parsed_line(parsed_line_t *line)
+{
+    arena_destroy(&line->arena);
+    free(line);
+}
+
+static void cache_remove(parsed_line_t *line)
+{
+    parsed_line_t **link = &cache_buckets[line->hash % PARSE_CACHE_BUCKETS];
+    while (*link && *link != line)
+        link = &(*link)->bucket_next;
+    if (*link)
+        *link = line->bucket_next;
+
+    lru_unlink(line);
+    cache_count--;
+    free_parsed_line(line);
+}
 
-    DEBUG_VERBOSE("Tokens after expansion:");
-    for (int i = 0; i < token_count && tokens[i].type != TOKEN_EOF; i++)
+// Drop least recently used lines that nobody is executing right now
+static void cache_evict(void)
+{
+    parsed_line_t *line = lru_tail;
+    while (cache_count > PARSE_CACHE_SIZE && line)
+    {
+        parsed_line_t *prev = line->lru_prev;
+        if (line->refs == 0)
+            cache_remove(line);
+        line = prev;
+    }
+}
+
+static parsed_line_t *parse_uncached(const char *input, size_t hash)
+{
+    parsed_line_t *line = calloc(1, sizeof(parsed_line_t));
+    if (!line)
+        return NULL;
+
+    arena_init(&line->arena);
+    line->hash = hash;
+    line->source = arena_strndup(&line->arena, input, strlen(input));
+    if (!line->source)
+    {
+        free_parsed_line(line);
+        return NULL;
+    }
+
+    token_buf_t buf;
+    token_buf_init(&buf);
+    if (tokenize(line->source, &buf) != 0)
     {
-        DEBUG_VERBOSE("Token %d: '%s'", i, tokens[i].value);
+        token_buf_free(&buf);
+        free_parsed_line(line);
+        return NULL;
     }
+    token_t *tokens = buf.tokens;
 
-    int token_idx = 0;
+    DEBUG_VERBOSE("Tokens:");
+    for (int i = 0; i < buf.count && tokens[i].type != TOKEN_EOF; i++)
+    {
+        DEBUG_VERBOSE("Token %d: '%.*s'", i, (int)tokens[i].len, tokens[i].start);
+    }
 
-    while (tokens[token_idx].type != TOKEN_EOF && cmd_list->count < MAX_COMMANDS)
+    if (tokens[0].type != TOKEN_EOF)
     {
-        command_t *current_cmd = &cmd_list->commands[cmd_list->count];
-        current_cmd->is_background = 0;
-        current_cmd->redirect_count = 0;
-        current_cmd->condition = EXEC_NORMAL;
-        int arg_count = 0;
-
-        // Parse command and arguments
-        while (tokens[token_idx].type == TOKEN_WORD && arg_count < MAX_ARGS - 1)
+        parser_t parser = {tokens, 0, &line->arena, 0};
+        line->ast = parse_list(&parser);
+
+        // Anything left over (e.g. a stray ')') is an error too
+        if (line->ast && peek(&parser) != TOKEN_EOF)
+            syntax_error(&parser);
+
+        if (!line->ast || parser.failed)
         {
-            current_cmd->args[arg_count++] = strdup(tokens[token_idx].value);
-            token_idx++;
+            token_buf_free(&buf);
+            free_parsed_line(line);
+            return NULL;
         }
-        current_cmd->args[arg_count] = NULL;
+    }
 
-        // Parse redirections (your existing redirection code)
-        while (token_idx < token_count &&
-               current_cmd->redirect_count < MAX_REDIRECTIONS)
+    token_buf_free(&buf);
+    return line;
+}
+
+static parsed_line_t *lookup_or_parse(const char *input)
+{
+
+    size_t hash = hash_line(input);
+    parsed_line_t **bucket = &cache_buckets[hash % PARSE_CACHE_BUCKETS];
+
+    for (parsed_line_t *line = *bucket; line; line = line->bucket_next)
+    {
+        if (line->hash == hash && strcmp(line->source, input) == 0)
         {
+            DEBUG_VERBOSE("Parse cache hit: '%s'", input);
+            cache_hits++;
+            lru_unlink(line);
+            lru_push_front(line);
+            line->refs++;
+            return line;
+        }
+    }
 
-            redirection_t *redir = &current_cmd->redirections[current_cmd->redirect_count];
+    cache_misses++;
+    parsed_line_t *line = parse_uncached(input, hash);
+    if (!line)
+        return NULL;
 
-            switch (tokens[token_idx].type)
-            {
-            case TOKEN_REDIRECT_OUT:
-                redir->type = REDIRECT_OUTPUT;
-                redir->fd = STDOUT_FILENO;
-                break;
-            case TOKEN_REDIRECT_APPEND:
-                redir->type = REDIRECT_APPEND;
-                redir->fd = STDOUT_FILENO;
-                break;
-            case TOKEN_REDIRECT_IN:
-                redir->type = REDIRECT_INPUT;
-                redir->fd = STDIN_FILENO;
-                break;
-            case TOKEN_REDIRECT_ERR:
-                redir->type = REDIRECT_ERROR;
-                redir->fd = STDERR_FILENO;
-                break;
-            case TOKEN_REDIRECT_BOTH:
-                redir->type = REDIRECT_BOTH;
-                redir->fd = STDOUT_FILENO;
-                break;
-            default:
-                goto end_redirections;
-            }
+    line->bucket_next = *bucket;
+    *bucket = line;
+    lru_push_front(line);
+    cache_count++;
+    line->refs++;
+
+    cache_evict();
+    return line;
+}
 
-            token_idx++;
+parsed_line_t *parse_command_line(const char *input)
+{
+    if (!input)
+        return NULL;
 
-            if (tokens[token_idx].type == TOKEN_WORD)
-            {
-                redir->filename = strdup(tokens[token_idx].value);
-                token_idx++;
-                current_cmd->redirect_count++;
-            }
-            else
-            {
-                DEBUG_ERROR("Expected filename after redirection");
-                goto end_redirections;
-            }
-        }
+    uint64_t span = TRACE_BEGIN();
+    parsed_line_t *line = lookup_or_parse(input);
+    TRACE_END(span, "parse", input);
+    return line;
+}
 
-    end_redirections:
+void release_command_line(parsed_line_t *line)
+{
+    if (line && line->refs > 0)
+        line->refs--;
+}
 
-        current_cmd->next_operator = OP_NONE;
+void clear_parse_cache(void)
+{
+    parsed_line_t *line = lru_head;
+    while (line)
+    {
+        parsed_line_t *next = line->lru_next;
+        if (line->refs == 0)
+            cache_remove(line);
+        line = next;
+    }
+}
 
-        // Check for background or pipeline continuation
-        if (tokens[token_idx].type == TOKEN_BACKGROUND)
-        {
-            current_cmd->is_background = 1;
-            current_cmd->next_operator = OP_BACKGROUND;
-            token_idx++;
-        }
-        else if (tokens[token_idx].type == TOKEN_PIPE)
-        {
-            current_cmd->next_operator = OP_PIPE;
-            token_idx++;
-        }
-        else if (tokens[token_idx].type == TOKEN_SEMICOLON)
+void parse_cache_stats(unsigned long *hits, unsigned long *misses)
+{
+    if (hits)
+        *hits = cache_hits;
+    if (misses)
+        *misses = cache_misses;
+}
+
+// =================================================================
+// Expansion pass (runs on every execution, cached or not)
+// =================================================================
+
+typedef struct
+{
+    const char *ptr;
+    size_t len;
+} piece_t;
+
+// Expand @vars outside single quotes and drop the quotes
+static char *expand_word(const word_t *word, arena_t *arena)
+{
+    if (!(word->flags & WORD_EXPAND))
+        return word->text;
+
+    const char *s = word->text;
+    size_t len = strlen(s);
+    const char *end = s + len;
+
+    // At most one piece per quote boundary
+    piece_t *pieces = arena_alloc(arena, (len + 1) * sizeof(piece_t));
+    if (!pieces)
+        return NULL;
+    int count = 0;
+    size_t total = 0;
+
+    while (s < end)
+    {
+        const char *seg_start = s;
+        const char *seg_end;
+        int literal = 0;
+
+        if (*s == '\'' && memchr(s + 1, '\'', end - s - 1))
         {
-            current_cmd->next_operator = OP_SEMICOLON;
-            token_idx++;
+            seg_start = s + 1;
+            seg_end = memchr(seg_start, '\'', end - seg_start);
+            literal = 1;
+            s = seg_end + 1;
         }
-        else if (tokens[token_idx].type == TOKEN_AND)
+        else if (*s == '"' && memchr(s + 1, '"', end - s - 1))
         {
-            current_cmd->next_operator = OP_AND;
-            token_idx++;
-            DEBUG_VERBOSE("Found && operator");
+            seg_start = s + 1;
+            seg_end = memchr(seg_start, '"', end - seg_start);
+            s = seg_end + 1;
         }
-        else if (tokens[token_idx].type == TOKEN_OR)
+        else
         {
-            current_cmd->next_operator = OP_OR;
-            token_idx++;
-            DEBUG_VERBOSE("Found || operator");
+            // Unquoted run up to the next quote that really opens a region
+            const char *q = s + 1;
+            while (q < end && !((*q == '\'' || *q == '"') && memchr(q + 1, *q, end - q - 1)))
+                q++;
+            seg_end = q;
+            s = q;
         }
 
-        // Skip empty commands
-        if (arg_count > 0)
+        size_t seg_len = seg_end - seg_start;
+        const char *out = seg_start;
+
+        if (!literal && memchr(seg_start, '@', seg_len))
         {
-            cmd_list->count++;
+            char *raw = arena_strndup(arena, seg_start, seg_len);
+            if (!raw)
+                return NULL;
+            out = expand_variables_arena(raw, arena);
+            if (!out)
+                return NULL;
+            seg_len = strlen(out);
         }
+
+        pieces[count].ptr = out;
+        pieces[count].len = seg_len;
+        count++;
+        total += seg_len;
     }
 
-    free(expanded_input);
+    char *result = arena_alloc(arena, total + 1);
+    if (!result)
+        return NULL;
 
-    // Free tokens
-    for (int i = 0; i < token_count; i++)
+    char *dst = result;
+    for (int i = 0; i < count; i++)
     {
-        if (tokens[i].value)
-        {
-            free(tokens[i].value);
-        }
+        memcpy(dst, pieces[i].ptr, pieces[i].len);
+        dst += pieces[i].len;
     }
+    *dst = '\0';
+    return result;
 }
 
-void free_command_list(command_list_t *cmd_list)
+static int push_arg(command_t *cmd, int *cap, char *arg, arena_t *arena)
 {
-    for (int i = 0; i < cmd_list->count; i++)
+    // Keep room for the NULL terminator
+    if (cmd->argc + 1 >= *cap)
     {
+        int new_cap = *cap * 2;
+        char **grown = arena_alloc(arena, new_cap * sizeof(char *));
+        if (!grown)
+            return -1;
+        memcpy(grown, cmd->args, cmd->argc * sizeof(char *));
+        cmd->args = grown;
+        *cap = new_cap;
+    }
+    cmd->args[cmd->argc++] = arg;
+    return 0;
+}
+
+// Unquoted expansions are split on whitespace, so VAR="ls -la"; @VAR works
+static int push_split(command_t *cmd, int *cap, char *value, arena_t *arena)
+{
+    char *s = value;
+    while (*s)
+    {
+        while (isspace((unsigned char)*s))
+            *s++ = '\0';
+        if (!*s)
+            break;
+
+        if (push_arg(cmd, cap, s, arena) != 0)
+            return -1;
+        while (*s && !isspace((unsigned char)*s))
+            s++;
+    }
+    return 0;
+}
+
+int expand_command(const ast_node_t *node, command_t *cmd, arena_t *arena)
+{
+    memset(cmd, 0, sizeof(*cmd));
+    cmd->is_background = node->background;
+
+    if (node->type == NODE_SUBSHELL)
+    {
+        cmd->subshell = node->children[0];
+    }
+    else
+    {
+        int cap = node->count + 1;
+        cmd->args = arena_alloc(arena, cap * sizeof(char *));
+        if (!cmd->args)
+            return -1;
 
-        // free args
-        for (int j = 0; cmd_list->commands[i].args[j] != NULL; j++)
+        for (int i = 0; i < node->count; i++)
         {
-            free(cmd_list->commands[i].args[j]);
+            const word_t *word = &node->words[i];
+            char *value = expand_word(word, arena);
+            if (!value)
+                return -1;
+
+            int rc = (word->flags & (WORD_EXPAND | WORD_QUOTED)) == WORD_EXPAND
+                         ? push_split(cmd, &cap, value, arena)
+                         : push_arg(cmd, &cap, value, arena);
+            if (rc != 0)
+                return -1;
         }
+        cmd->args[cmd->argc] = NULL;
+    }
+
+    if (node->redirect_count > 0)
+    {
+        cmd->redirections = arena_alloc(arena, node->redirect_count * sizeof(redirection_t));
+        if (!cmd->redirections)
+            return -1;
 
-        // Free redirection filenames
-        for (int j = 0; j < cmd_list->commands[i].redirect_count; j++)
+        for (int i = 0; i < node->redirect_count; i++)
         {
-            free(cmd_list->commands[i].redirections[j].filename);
+            redirection_t *redir = &cmd->redirections[i];
+            redir->type = node->redirections[i].type;
+            redir->filename = expand_word(&node->redirections[i].target, arena);
+            if (!redir->filename)
+                return -1;
+
+            switch (redir->type)
+            {
+            case REDIRECT_INPUT:
+                redir->fd = STDIN_FILENO;
+                break;
+            case REDIRECT_ERROR:
+                redir->fd = STDERR_FILENO;
+                break;
+            default:
+                redir->fd = STDOUT_FILENO;
+                break;
+            }
         }
+        cmd->redirect_count = node->redirect_count;
     }
-    cmd_list->count = 0;
+
+    return 0;
 }
@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "pathcache.h"
+#include "variables.h"
+#include "debug.h"
+
+static path_entry_t *path_table[PATH_CACHE_SIZE];
+static unsigned long cache_hits = 0;
+static unsigned long cache_misses = 0;
+
+static unsigned int path_hash(const char *str) {
+    unsigned int hash = 5381;
+    int c;
+
+    while ((c = *str++)) {
+        hash = ((hash << 5) + hash) + c; // hash * 33 + c
+    }
+
+    return hash % PATH_CACHE_SIZE;
+}
+
+static int is_executable_file(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISREG(st.st_mode) && access(path, X_OK) == 0;
+}
+
+// Walk $PATH once for name, same order execvp would use
+static char* search_path(const char *name) {
+    const char *path_var = get_variable("PATH");
+    if (!path_var) {
+        path_var = "/usr/local/bin:/usr/bin:/bin";
+    }
+
+    size_t name_len = strlen(name);
+    const char *dir = path_var;
+
+    while (1) {
+        const char *end = strchr(dir, ':');
+        size_t dir_len = end ? (size_t)(end - dir) : strlen(dir);
+
+        // Empty PATH component means current directory
+        char *candidate = malloc(dir_len + name_len + 3);
+        if (!candidate) return NULL;
+
+        if (dir_len == 0) {
+            snprintf(candidate, name_len + 3, "./%s", name);
+        } else {
+            memcpy(candidate, dir, dir_len);
+            candidate[dir_len] = '/';
+            memcpy(candidate + dir_len + 1, name, name_len + 1);
+        }
+
+        if (is_executable_file(candidate)) {
+            return candidate;
+        }
+        free(candidate);
+
+        if (!end) break;
+        dir = end + 1;
+    }
+
+    return NULL;
+}
+
+static path_entry_t* find_entry(const char *name, unsigned int bucket) {
+    for (path_entry_t *e = path_table[bucket]; e; e = e->next) {
+        if (strcmp(e->name, name) == 0) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+static void remove_entry(const char *name) {
+    unsigned int bucket = path_hash(name);
+    path_entry_t *prev = NULL;
+
+    for (path_entry_t *e = path_table[bucket]; e; prev = e, e = e->next) {
+        if (strcmp(e->name, name) == 0) {
+            if (prev) {
+                prev->next = e->next;
+            } else {
+                path_table[bucket] = e->next;
+            }
+            free(e->name);
+            free(e->path);
+            free(e);
+            return;
+        }
+    }
+}
+
+const char* path_cache_lookup(const char *name) {
+    if (!name || !*name) return NULL;
+
+    // Explicit paths bypass the table, like bash
+    if (strchr(name, '/')) return name;
+
+    unsigned int bucket = path_hash(name);
+    path_entry_t *entry = find_entry(name, bucket);
+    if (entry) {
+        entry->hits++;
+        cache_hits++;
+        return entry->path;
+    }
+
+    cache_misses++;
+    char *path = search_path(name);
+    if (!path) {
+        DEBUG_VERBOSE("hash: %s not found in PATH", name);
+        return NULL;
+    }
+
+    entry = malloc(sizeof(path_entry_t));
+    if (!entry) {
+        free(path);
+        return NULL;
+    }
+    entry->name = strdup(name);
+    entry->path = path;
+    entry->hits = 1;
+    entry->next = path_table[bucket];
+    path_table[bucket] = entry;
+
+    DEBUG_VERBOSE("hash: cached %s -> %s", name, path);
+    return entry->path;
+}
+
+int path_cache_insert(const char *name, const char *path) {
+    if (!name || !path || strchr(name, '/')) return -1;
+
+    remove_entry(name);
+
+    path_entry_t *entry = malloc(sizeof(path_entry_t));
+    if (!entry) return -1;
+
+    unsigned int bucket = path_hash(name);
+    entry->name = strdup(name);
+    entry->path = strdup(path);
+    entry->hits = 0;
+    entry->next = path_table[bucket];
+    path_table[bucket] = entry;
+    return 0;
+}
+
+int path_cache_rehash(const char *name) {
+    if (!name || strchr(name, '/')) return -1;
+
+    remove_entry(name);
+    if (!path_cache_lookup(name)) return -1;
+
+    // Explicit `hash name` shouldn't count as a use
+    path_entry_t *entry = find_entry(name, path_hash(name));
+    entry->hits = 0;
+    return 0;
+}
+
+const char* path_cache_revalidate(const char *name) {
+    if (!name) return NULL;
+    if (strchr(name, '/')) return name;
+
+    path_entry_t *entry = find_entry(name, path_hash(name));
+    if (entry && is_executable_file(entry->path)) {
+        return entry->path;  // Entry is fine, the failure was something else
+    }
+
+    DEBUG_INFO("hash: %s is stale, searching PATH again", name);
+    remove_entry(name);
+    return path_cache_lookup(name);
+}
+
+void path_cache_clear(void) {
+    for (int i = 0; i < PATH_CACHE_SIZE; i++) {
+        path_entry_t *e = path_table[i];
+        while (e) {
+            path_entry_t *next = e->next;
+            free(e->name);
+            free(e->path);
+            free(e);
+            e = next;
+        }
+        path_table[i] = NULL;
+    }
+}
+
+void path_cache_print(int reusable) {
+    int count = 0;
+
+    for (int i = 0; i < PATH_CACHE_SIZE; i++) {
+        for (path_entry_t *e = path_table[i]; e; e = e->next) {
+            if (!reusable && count == 0) {
+                printf("hits\tcommand\n");
+            }
+            if (reusable) {
+                printf("hash -p %s %s\n", e->path, e->name);
+            } else {
+                printf("%4lu\t%s\n", e->hits, e->path);
+            }
+            count++;
+        }
+    }
+
+    if (count == 0) {
+        printf("hash: hash table empty\n");
+    }
+}
+
+void path_cache_stats(unsigned long *hits, unsigned long *misses) {
+    if (hits) *hits = cache_hits;
+    if (misses) *misses = cache_misses;
+}
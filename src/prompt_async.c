@@ -0,0 +1,420 @@
+#define _GNU_SOURCE     // pipe2
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "prompt_async.h"
+#include "variables.h"
+
+typedef void (*provider_fn)(const char *dir, char *const envp[], char *out, size_t size);
+
+typedef struct {
+    int used;
+    async_provider_t provider;
+    char dir[PATH_MAX];
+    char value[ASYNC_VALUE_MAX];
+    unsigned long epoch;        // epoch the value was computed in
+    unsigned long last_use;     // for LRU eviction
+} async_entry_t;
+
+typedef struct {
+    int pending;
+    async_provider_t provider;
+    char dir[PATH_MAX];
+    unsigned long epoch;
+    char **envp;                // copy of the shell's environment, one block
+} async_request_t;
+
+static void git_segment(const char *dir, char *const envp[], char *out, size_t size);
+
+static const provider_fn providers[ASYNC_PROVIDER_COUNT] = {
+    [ASYNC_GIT] = git_segment,
+};
+
+// Everything below is shared with the worker and guarded by async_lock
+static pthread_mutex_t async_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t request_cond = PTHREAD_COND_INITIALIZER;     // worker waits
+static pthread_cond_t done_cond;                                    // prompt waits
+static async_entry_t cache[ASYNC_CACHE_SIZE];
+static async_request_t request;     // next thing to compute (latest wins)
+static async_request_t current;     // what the worker is computing
+static int busy = 0;
+static int waiting = 0;             // the prompt is inside its deadline
+static unsigned long epoch = 1;
+static unsigned long value_gen = 0;
+static unsigned long use_tick = 0;
+
+// Main thread only
+static int notify_pipe[2] = {-1, -1};
+static int started = 0;
+static char shown[ASYNC_PROVIDER_COUNT][ASYNC_VALUE_MAX];
+
+static async_entry_t* find_entry(async_provider_t provider, const char *dir) {
+    for (int i = 0; i < ASYNC_CACHE_SIZE; i++) {
+        if (cache[i].used && cache[i].provider == provider && strcmp(cache[i].dir, dir) == 0) {
+            return &cache[i];
+        }
+    }
+    return NULL;
+}
+
+// Existing entry, else a free or the least recently used one
+static async_entry_t* claim_entry(async_provider_t provider, const char *dir) {
+    async_entry_t *entry = find_entry(provider, dir);
+    if (entry) return entry;
+
+    entry = &cache[0];
+    for (int i = 0; i < ASYNC_CACHE_SIZE; i++) {
+        if (!cache[i].used) {
+            entry = &cache[i];
+            break;
+        }
+        if (cache[i].last_use < entry->last_use) entry = &cache[i];
+    }
+    entry->used = 1;
+    entry->provider = provider;
+    snprintf(entry->dir, sizeof(entry->dir), "%s", dir);
+    entry->value[0] = '\0';
+    entry->epoch = 0;
+    entry->last_use = ++use_tick;
+    return entry;
+}
+
+// The worker can't call get_environment(): the variable table is the main
+// thread's. Requests carry their own copy, pointers and strings in one block.
+static char** copy_environment(void) {
+    char **env = get_environment();
+    if (!env) return NULL;
+
+    size_t count = 0, bytes = 0;
+    for (; env[count]; count++) {
+        bytes += strlen(env[count]) + 1;
+    }
+
+    char **copy = malloc((count + 1) * sizeof(char*) + bytes);
+    if (!copy) return NULL;
+
+    char *out = (char*)(copy + count + 1);
+    for (size_t i = 0; i < count; i++) {
+        size_t len = strlen(env[i]) + 1;
+        memcpy(out, env[i], len);
+        copy[i] = out;
+        out += len;
+    }
+    copy[count] = NULL;
+    return copy;
+}
+
+static int same_request(const async_request_t *req, async_provider_t provider, const char *dir) {
+    return req->provider == provider && req->epoch == epoch && strcmp(req->dir, dir) == 0;
+}
+
+static void* async_worker(void *unused) {
+    (void)unused;
+    pthread_mutex_lock(&async_lock);
+    for (;;) {
+        while (!request.pending) {
+            pthread_cond_wait(&request_cond, &async_lock);
+        }
+        current = request;
+        request.pending = 0;
+        request.envp = NULL;    // current owns it now
+        busy = 1;
+        pthread_mutex_unlock(&async_lock);
+
+        char value[ASYNC_VALUE_MAX];
+        providers[current.provider](current.dir, current.envp, value, sizeof(value));
+
+        pthread_mutex_lock(&async_lock);
+        busy = 0;
+        free(current.envp);
+        current.envp = NULL;
+        async_entry_t *entry = find_entry(current.provider, current.dir);
+        int changed = !entry || strcmp(entry->value, value) != 0;
+        if (!entry) entry = claim_entry(current.provider, current.dir);
+        snprintf(entry->value, sizeof(entry->value), "%s", value);
+        entry->epoch = current.epoch;   // stale already if a command ran meanwhile
+        if (changed) value_gen++;
+
+        pthread_cond_broadcast(&done_cond);
+        if (changed && !waiting) {
+            // Too late for the prompt on screen: have it redrawn
+            ssize_t n = write(notify_pipe[1], "", 1);
+            (void)n;
+        }
+    }
+    return NULL;
+}
+
+void async_segments_init(void) {
+    if (started) return;
+
+    if (pipe2(notify_pipe, O_CLOEXEC | O_NONBLOCK) == -1) {
+        return;
+    }
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&done_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    // Signals (SIGCHLD, SIGINT, ...) stay with the main thread
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, async_worker, NULL) == 0) {
+        pthread_detach(thread);
+        started = 1;
+    } else {
+        close(notify_pipe[0]);
+        close(notify_pipe[1]);
+        notify_pipe[0] = notify_pipe[1] = -1;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+const char* async_segment_get(async_provider_t provider, const char *dir) {
+    char *out = shown[provider];
+    if (!started) {
+        out[0] = '\0';
+        return out;
+    }
+
+    pthread_mutex_lock(&async_lock);
+    async_entry_t *entry = find_entry(provider, dir);
+
+    if (!entry || entry->epoch != epoch) {
+        if (!(busy && same_request(&current, provider, dir)) &&
+            !(request.pending && same_request(&request, provider, dir))) {
+            free(request.envp);     // superseded before the worker took it
+            request.pending = 1;
+            request.provider = provider;
+            request.epoch = epoch;
+            request.envp = copy_environment();
+            snprintf(request.dir, sizeof(request.dir), "%s", dir);
+            pthread_cond_signal(&request_cond);
+        }
+
+        // A stale value is drawn right away; only a directory seen for the
+        // first time waits a little, so fast repos don't flash a placeholder
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_nsec += ASYNC_DEADLINE_MS * 1000000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+
+        waiting = !entry;
+        while (waiting && (!entry || entry->epoch != epoch)) {
+            if (pthread_cond_timedwait(&done_cond, &async_lock, &deadline) == ETIMEDOUT) {
+                entry = find_entry(provider, dir);
+                break;
+            }
+            entry = find_entry(provider, dir);
+        }
+        waiting = 0;
+    }
+
+    if (entry) {
+        entry->last_use = ++use_tick;
+        snprintf(out, ASYNC_VALUE_MAX, "%s", entry->value);
+    } else {
+        snprintf(out, ASYNC_VALUE_MAX, "%s", ASYNC_PLACEHOLDER);
+    }
+    pthread_mutex_unlock(&async_lock);
+    return out;
+}
+
+void async_segments_invalidate(void) {
+    if (!started) return;
+    pthread_mutex_lock(&async_lock);
+    epoch++;
+    pthread_mutex_unlock(&async_lock);
+}
+
+int async_segments_fd(void) {
+    return notify_pipe[0];
+}
+
+int async_segments_drain(void) {
+    char buf[64];
+    int got = 0;
+    while (read(notify_pipe[0], buf, sizeof(buf)) > 0) {
+        got = 1;
+    }
+    return got;
+}
+
+unsigned long async_segments_gen(void) {
+    if (!started) return 0;
+    pthread_mutex_lock(&async_lock);
+    unsigned long gen = value_gen;
+    pthread_mutex_unlock(&async_lock);
+    return gen;
+}
+
+// =================================================================
+// Providers - run on the worker thread, must not touch shell state
+// =================================================================
+
+// Cheap check before spawning anything: a .git somewhere above dir
+static int inside_git_repo(const char *dir) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s", dir);
+
+    for (;;) {
+        char probe[PATH_MAX + 8];
+        struct stat st;
+        snprintf(probe, sizeof(probe), "%s/.git", path);
+        if (stat(probe, &st) == 0) return 1;
+
+        char *slash = strrchr(path, '/');
+        if (!slash || slash == path) break;
+        *slash = '\0';
+    }
+    return stat("/.git", &(struct stat){0}) == 0;
+}
+
+// name looked up in envp's PATH, like execvp would with that environment
+static int find_program(const char *name, char *const envp[], char *path, size_t size) {
+    const char *search = "/usr/bin:/bin";
+    for (size_t i = 0; envp[i]; i++) {
+        if (strncmp(envp[i], "PATH=", 5) == 0) {
+            search = envp[i] + 5;
+            break;
+        }
+    }
+
+    while (*search) {
+        size_t len = strcspn(search, ":");
+        // An empty entry means the current directory
+        int n = len ? snprintf(path, size, "%.*s/%s", (int)len, search, name)
+                    : snprintf(path, size, "%s", name);
+        if (n > 0 && (size_t)n < size && access(path, X_OK) == 0) return 0;
+        search += len;
+        if (*search == ':') search++;
+    }
+    return -1;
+}
+
+// Run argv with envp and stdout on a pipe, ASYNC_TIMEOUT_MS at most. Returns
+// the exit status (-1 if it couldn't run or was killed), output in out.
+static int run_capture(char *const argv[], char *const envp[], char *out, size_t size) {
+    char program[PATH_MAX];
+    if (!envp || find_program(argv[0], envp, program, sizeof(program)) != 0) return -1;
+
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) == -1) return -1;
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+
+    // Own process group, away from the terminal; default signals and an
+    // empty mask rather than the shell's ignores and this thread's mask
+    posix_spawnattr_t attr;
+    sigset_t none, defaults;
+    sigemptyset(&none);
+    sigfillset(&defaults);
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK |
+                                    POSIX_SPAWN_SETSIGDEF);
+    posix_spawnattr_setpgroup(&attr, 0);
+    posix_spawnattr_setsigmask(&attr, &none);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+
+    pid_t pid;
+    int err = posix_spawn(&pid, program, &actions, &attr, argv, envp);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    close(fds[1]);
+    if (err != 0) {
+        close(fds[0]);
+        return -1;
+    }
+
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    size_t len = 0;
+    int killed = 0;
+
+    for (;;) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long elapsed = (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000;
+        if (elapsed >= ASYNC_TIMEOUT_MS) {
+            kill(-pid, SIGKILL);     // its own group: hooks and helpers too
+            killed = 1;
+            break;
+        }
+
+        struct pollfd pfd = {.fd = fds[0], .events = POLLIN};
+        if (poll(&pfd, 1, ASYNC_TIMEOUT_MS - elapsed) < 0 && errno != EINTR) break;
+
+        char buf[4096];
+        ssize_t n = read(fds[0], buf, sizeof(buf));
+        if (n == 0) break;
+        if (n < 0) {
+            if (errno == EINTR || errno == EAGAIN) continue;
+            break;
+        }
+        // Only the start matters; the rest is read so the child can finish
+        if (len < size - 1) {
+            size_t take = (size_t)n < size - 1 - len ? (size_t)n : size - 1 - len;
+            memcpy(out + len, buf, take);
+            len += take;
+        }
+    }
+    out[len] = '\0';
+    close(fds[0]);
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+        continue;
+    }
+    if (killed || !WIFEXITED(status)) return -1;
+    return WEXITSTATUS(status);
+}
+
+// "main", "main*" if tracked files changed, "" outside a repository
+static void git_segment(const char *dir, char *const envp[], char *out, size_t size) {
+    out[0] = '\0';
+    if (!inside_git_repo(dir)) return;
+
+    char *argv[] = {"git", "--no-optional-locks", "-C", (char *)dir, "status",
+                    "--porcelain=v1", "--branch", "--untracked-files=no", NULL};
+    char output[1024];
+    int status = run_capture(argv, envp, output, sizeof(output));
+    if (status == -1) {
+        snprintf(out, size, "?");       // timed out or no git
+        return;
+    }
+    if (status != 0 || strncmp(output, "## ", 3) != 0) return;
+
+    // ## main...origin/main [ahead 1]  |  ## No commits yet on main  |  ## HEAD (no branch)
+    const char *branch = output + 3;
+    const char *on = strstr(branch, " on ");
+    char *eol = strchr(output, '\n');
+    if (on && (!eol || on < eol) && strncmp(branch, "No commits yet", 14) == 0) {
+        branch = on + 4;
+    }
+    size_t len = strcspn(branch, " \n");
+    const char *upstream = strstr(branch, "...");
+    if (upstream && (size_t)(upstream - branch) < len) len = upstream - branch;
+    int dirty = eol && eol[1] != '\0';
+
+    snprintf(out, size, "%.*s%s", (int)len, branch, dirty ? "*" : "");
+}
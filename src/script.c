@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "script.h"
+#include "debug.h"
+
+#define SCRIPT_READ_SIZE (64 * 1024)
+
+// Reusable scratch line, the parser needs a writable NUL-terminated string
+typedef struct {
+    char *data;
+    size_t cap;
+} line_buf_t;
+
+static int dispatch_line(line_buf_t *line, const char *start, size_t len,
+                         line_handler_t handler, int *status) {
+    // Trim CR (scripts edited on Windows) and leading blanks
+    while (len > 0 && (start[len - 1] == '\r' || start[len - 1] == ' ' || start[len - 1] == '\t'))
+        len--;
+    while (len > 0 && (*start == ' ' || *start == '\t')) {
+        start++;
+        len--;
+    }
+
+    // Blank lines and comments (including #! shebang) are skipped
+    if (len == 0 || *start == '#')
+        return 0;
+
+    if (len + 1 > line->cap) {
+        size_t new_cap = line->cap ? line->cap : 256;
+        while (new_cap < len + 1)
+            new_cap *= 2;
+        char *grown = realloc(line->data, new_cap);
+        if (!grown) {
+            DEBUG_ERROR("Out of memory reading script line");
+            return -1;
+        }
+        line->data = grown;
+        line->cap = new_cap;
+    }
+
+    memcpy(line->data, start, len);
+    line->data[len] = '\0';
+
+    DEBUG_VERBOSE("Script line: '%s'", line->data);
+    *status = handler(line->data);
+    return 0;
+}
+
+// Split an in-memory buffer into lines and run each one
+static int run_buffer(const char *data, size_t size, line_handler_t handler) {
+    line_buf_t line = {NULL, 0};
+    int status = 0;
+    const char *pos = data;
+    const char *end = data + size;
+
+    while (pos < end) {
+        const char *nl = memchr(pos, '\n', end - pos);
+        size_t len = nl ? (size_t)(nl - pos) : (size_t)(end - pos);
+
+        if (dispatch_line(&line, pos, len, handler, &status) != 0)
+            break;
+
+        pos += len + 1;
+    }
+
+    free(line.data);
+    return status;
+}
+
+int run_script_string(const char *text, line_handler_t handler) {
+    if (!text) return 0;
+    return run_buffer(text, strlen(text), handler);
+}
+
+int run_script_file(const char *path, line_handler_t handler) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        fprintf(stderr, "nutshell: %s: %s\n", path, strerror(errno));
+        return 127;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+        // Pipes, FIFOs, /dev/stdin: can't map them, stream instead
+        int status = run_script_fd(fd, handler);
+        close(fd);
+        return status;
+    }
+
+    if (st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        int status = run_script_fd(fd, handler);
+        close(fd);
+        return status;
+    }
+    close(fd);
+
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    int status = run_buffer(map, st.st_size, handler);
+    munmap(map, st.st_size);
+    return status;
+}
+
+// Note: input is read ahead in big blocks, so commands that read stdin
+// themselves won't see the script lines we've already buffered
+int run_script_fd(int fd, line_handler_t handler) {
+    line_buf_t line = {NULL, 0};
+    size_t cap = SCRIPT_READ_SIZE;
+    size_t used = 0;
+    int status = 0;
+    char *buf = malloc(cap);
+
+    if (!buf) {
+        DEBUG_ERROR("Out of memory reading script");
+        return 1;
+    }
+
+    while (1) {
+        // Make room for a full block; a single huge line grows the buffer
+        if (cap - used < SCRIPT_READ_SIZE / 2) {
+            char *grown = realloc(buf, cap * 2);
+            if (!grown) {
+                DEBUG_ERROR("Out of memory reading script");
+                break;
+            }
+            buf = grown;
+            cap *= 2;
+        }
+
+        ssize_t n = read(fd, buf + used, cap - used);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("nutshell: read");
+            break;
+        }
+
+        if (n == 0) {
+            // EOF: last line may not end with newline
+            if (used > 0)
+                dispatch_line(&line, buf, used, handler, &status);
+            break;
+        }
+
+        used += n;
+
+        // Run every complete line in the block
+        char *pos = buf;
+        char *end = buf + used;
+        char *nl;
+        int failed = 0;
+        while ((nl = memchr(pos, '\n', end - pos)) != NULL) {
+            if (dispatch_line(&line, pos, nl - pos, handler, &status) != 0) {
+                failed = 1;
+                break;
+            }
+            pos = nl + 1;
+        }
+        if (failed) break;
+
+        // Keep the partial tail for the next read
+        used = end - pos;
+        memmove(buf, pos, used);
+    }
+
+    free(buf);
+    free(line.data);
+    return status;
+}
@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <string.h>
+#include "timing.h"
+#include "variables.h"
+
+static timing_record_t timing_ring[TIMING_LOG_SIZE];
+static int timing_next = 0;         // slot the next record goes to
+static int timing_count = 0;
+static unsigned long timing_total = 0;  // records ever logged, numbers them
+
+static double timeval_seconds(const struct timeval *tv) {
+    return tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+void timing_summarize(timing_record_t *rec, const job_result_t *stages, int count,
+                      const struct rusage *self_before, const struct rusage *self_after) {
+    rec->stages = count;
+    rec->user = timeval_seconds(&self_after->ru_utime) - timeval_seconds(&self_before->ru_utime);
+    rec->sys = timeval_seconds(&self_after->ru_stime) - timeval_seconds(&self_before->ru_stime);
+    rec->max_rss_kb = 0;
+    rec->voluntary_csw = 0;
+    rec->involuntary_csw = 0;
+
+    for (int i = 0; i < count; i++) {
+        const struct rusage *ru = &stages[i].usage;
+        rec->user += timeval_seconds(&ru->ru_utime);
+        rec->sys += timeval_seconds(&ru->ru_stime);
+        if (ru->ru_maxrss > rec->max_rss_kb) rec->max_rss_kb = ru->ru_maxrss;
+        rec->voluntary_csw += ru->ru_nvcsw;
+        rec->involuntary_csw += ru->ru_nivcsw;
+    }
+}
+
+// %[p][l]R|U|S: seconds with p decimals (default 3), l = 1m2.345s form
+static void print_seconds(FILE *out, double seconds, int precision, int long_form) {
+    if (long_form) {
+        int minutes = (int)(seconds / 60);
+        fprintf(out, "%dm%.*fs", minutes, precision, seconds - minutes * 60);
+    } else {
+        fprintf(out, "%.*f", precision, seconds);
+    }
+}
+
+// TIMEFORMAT like bash: %R %U %S %P %%, plus \n and \t escapes
+static void print_timeformat(FILE *out, const char *fmt, const timing_record_t *rec) {
+    for (const char *c = fmt; *c; c++) {
+        if (*c == '\\' && (c[1] == 'n' || c[1] == 't')) {
+            fputc(c[1] == 'n' ? '\n' : '\t', out);
+            c++;
+            continue;
+        }
+        if (*c != '%') {
+            fputc(*c, out);
+            continue;
+        }
+
+        c++;
+        int precision = 3;
+        int long_form = 0;
+        if (*c >= '0' && *c <= '9') {
+            precision = *c - '0' > 3 ? 3 : *c - '0';
+            c++;
+        }
+        if (*c == 'l') {
+            long_form = 1;
+            c++;
+        }
+
+        switch (*c) {
+            case 'R': print_seconds(out, rec->wall, precision, long_form); break;
+            case 'U': print_seconds(out, rec->user, precision, long_form); break;
+            case 'S': print_seconds(out, rec->sys, precision, long_form); break;
+            case 'P':
+                fprintf(out, "%.*f", precision > 2 ? 2 : precision,
+                        rec->wall > 0 ? (rec->user + rec->sys) * 100.0 / rec->wall : 0.0);
+                break;
+            case '%': fputc('%', out); break;
+            case '\0': return;
+            default: fputc('%', out); fputc(*c, out); break;
+        }
+    }
+}
+
+static void print_stage(FILE *out, int index, const job_result_t *stage, const char *label) {
+    const struct rusage *ru = &stage->usage;
+    fprintf(out, "%3d  real %.3fs  user %.3fs  sys %.3fs  rss %ldK  csw %ld/%ld  status %d%s%s\n",
+            index, stage->wall, timeval_seconds(&ru->ru_utime), timeval_seconds(&ru->ru_stime),
+            ru->ru_maxrss, ru->ru_nvcsw, ru->ru_nivcsw, stage->status,
+            label ? "  " : "", label ? label : "");
+}
+
+void timing_report(const timing_record_t *rec, const job_result_t *stages, int count,
+                   const char *const *labels) {
+    const char *fmt = get_variable("TIMEFORMAT");
+    print_timeformat(stderr, fmt ? fmt : TIMEFORMAT_DEFAULT, rec);
+    fputc('\n', stderr);
+
+    // Then what each process of the job used
+    for (int i = 0; i < count; i++) {
+        print_stage(stderr, i + 1, &stages[i], labels ? labels[i] : NULL);
+    }
+    fflush(stderr);
+}
+
+void timing_log(const timing_record_t *rec) {
+    timing_ring[timing_next] = *rec;
+    timing_next = (timing_next + 1) % TIMING_LOG_SIZE;
+    if (timing_count < TIMING_LOG_SIZE) timing_count++;
+    timing_total++;
+}
+
+void timing_print(int count) {
+    if (count <= 0 || count > timing_count) count = timing_count;
+
+    unsigned long number = timing_total - count + 1;
+    int slot = (timing_next - count + TIMING_LOG_SIZE) % TIMING_LOG_SIZE;
+
+    for (int i = 0; i < count; i++, number++) {
+        const timing_record_t *rec = &timing_ring[slot];
+        printf("%5lu  real %8.3fs  user %7.3fs  sys %7.3fs  rss %7ldK  csw %5ld/%-4ld  %3d  %s\n",
+               number, rec->wall, rec->user, rec->sys, rec->max_rss_kb,
+               rec->voluntary_csw, rec->involuntary_csw, rec->status, rec->command);
+        slot = (slot + 1) % TIMING_LOG_SIZE;
+    }
+}
+
+void timing_clear(void) {
+    timing_next = 0;
+    timing_count = 0;
+}
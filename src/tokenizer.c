@@ -0,0 +1,439 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "tokenizer.h"
+#include "debug.h"
+#include "trace.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TOKENIZER_X86 1
+#endif
+
+// Byte classes the scanner cares about
+#define CLASS_SPACE    0x1
+#define CLASS_QUOTE    0x2
+#define CLASS_OPERATOR 0x4
+
+// Same whitespace set as isspace() in the C locale
+static const unsigned char byte_class[256] = {
+    [' '] = CLASS_SPACE, ['\t'] = CLASS_SPACE, ['\n'] = CLASS_SPACE,
+    ['\v'] = CLASS_SPACE, ['\f'] = CLASS_SPACE, ['\r'] = CLASS_SPACE,
+    ['"'] = CLASS_QUOTE, ['\''] = CLASS_QUOTE,
+    ['|'] = CLASS_OPERATOR, ['&'] = CLASS_OPERATOR, [';'] = CLASS_OPERATOR,
+    ['<'] = CLASS_OPERATOR, ['>'] = CLASS_OPERATOR,
+    ['('] = CLASS_OPERATOR, [')'] = CLASS_OPERATOR,
+};
+
+// SIMD backends classify 64 bytes at once into bitmasks, and the tokenizer
+// then walks token boundaries with ctz instead of touching every byte
+typedef void (*classify_fn)(const char *p, uint64_t *special, uint64_t *space);
+
+typedef struct
+{
+    const char *end;
+    const char *base;      // first byte of the classified block
+    const char *limit;     // base + 64, or end for the last block
+    uint64_t special;      // bit i: base[i] is whitespace, quote or operator
+    uint64_t space;        // bit i: base[i] is whitespace
+} scanner_t;
+
+static classify_fn classify;    // NULL = plain scalar scanning
+static tokenizer_backend_t active_backend = TOKENIZER_AUTO;
+static int backend_ready = 0;
+
+// =================================================================
+// Scalar scanner (fallback when there is no SIMD)
+// =================================================================
+
+static const char *find_special_scalar(const char *p, const char *end)
+{
+    while (p < end && !byte_class[(unsigned char)*p])
+        p++;
+    return p;
+}
+
+static const char *skip_space_scalar(const char *p, const char *end)
+{
+    while (p < end && (byte_class[(unsigned char)*p] & CLASS_SPACE))
+        p++;
+    return p;
+}
+
+#ifdef TOKENIZER_X86
+
+// =================================================================
+// SSE2: 16 bytes per compare, 4 per block
+// The special set packs into a few ranges:
+//   \t..\r, ' ', '"', & ' ( ) (0x26-0x29), ; < (0x3b-0x3c), '>', '|'
+// =================================================================
+
+// (x - lo) <= (hi - lo), unsigned, per byte
+static inline __m128i in_range_sse2(__m128i x, char lo, char hi)
+{
+    __m128i t = _mm_sub_epi8(x, _mm_set1_epi8(lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(hi - lo)), t);
+}
+
+static void classify_sse2(const char *p, uint64_t *special, uint64_t *space)
+{
+    uint64_t sp = 0, ws = 0;
+
+    for (int i = 0; i < 4; i++)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + 16 * i));
+        __m128i w = _mm_or_si128(in_range_sse2(v, '\t', '\r'),
+                                 _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+        __m128i m = _mm_or_si128(w, _mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+        m = _mm_or_si128(m, in_range_sse2(v, '&', ')'));
+        m = _mm_or_si128(m, in_range_sse2(v, ';', '<'));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('>')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('|')));
+
+        ws |= (uint64_t)(uint16_t)_mm_movemask_epi8(w) << (16 * i);
+        sp |= (uint64_t)(uint16_t)_mm_movemask_epi8(m) << (16 * i);
+    }
+
+    *special = sp;
+    *space = ws;
+}
+
+// =================================================================
+// AVX2: 32 bytes per compare, 2 per block (only if the CPU has it)
+// =================================================================
+
+__attribute__((target("avx2")))
+static inline __m256i in_range_avx2(__m256i x, char lo, char hi)
+{
+    __m256i t = _mm256_sub_epi8(x, _mm256_set1_epi8(lo));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8(hi - lo)), t);
+}
+
+__attribute__((target("avx2")))
+static void classify_avx2(const char *p, uint64_t *special, uint64_t *space)
+{
+    uint64_t sp = 0, ws = 0;
+
+    for (int i = 0; i < 2; i++)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + 32 * i));
+        __m256i w = _mm256_or_si256(in_range_avx2(v, '\t', '\r'),
+                                    _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+        __m256i m = _mm256_or_si256(w, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')));
+        m = _mm256_or_si256(m, in_range_avx2(v, '&', ')'));
+        m = _mm256_or_si256(m, in_range_avx2(v, ';', '<'));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('>')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('|')));
+
+        ws |= (uint64_t)(uint32_t)_mm256_movemask_epi8(w) << (32 * i);
+        sp |= (uint64_t)(uint32_t)_mm256_movemask_epi8(m) << (32 * i);
+    }
+
+    *special = sp;
+    *space = ws;
+}
+
+#endif // TOKENIZER_X86
+
+// =================================================================
+// Block scanner
+// =================================================================
+
+static void load_block(scanner_t *s, const char *p)
+{
+    s->base = p;
+
+    if (s->end - p >= 64)
+    {
+        s->limit = p + 64;
+        classify(p, &s->special, &s->space);
+        return;
+    }
+
+    // Last partial block: classify a zero padded copy, never read past end
+    char pad[64] = {0};
+    size_t n = s->end - p;
+    memcpy(pad, p, n);
+    classify(pad, &s->special, &s->space);
+
+    uint64_t valid = (1ULL << n) - 1;   // n < 64 here
+    s->special &= valid;
+    s->space &= valid;
+    s->limit = s->end;
+}
+
+// First whitespace/quote/operator byte at or after p, or end
+static inline const char *scan_special(scanner_t *s, const char *p)
+{
+    if (!classify)
+        return find_special_scalar(p, s->end);
+
+    while (p < s->end)
+    {
+        if (p < s->base || p >= s->limit)
+            load_block(s, p);
+
+        uint64_t m = s->special >> (p - s->base);
+        if (m)
+            return p + __builtin_ctzll(m);
+        p = s->limit;
+    }
+    return s->end;
+}
+
+// First non-whitespace byte at or after p, or end
+static inline const char *scan_nonspace(scanner_t *s, const char *p)
+{
+    if (!classify)
+        return skip_space_scalar(p, s->end);
+
+    while (p < s->end)
+    {
+        if (p < s->base || p >= s->limit)
+            load_block(s, p);
+
+        uint64_t m = ~s->space >> (p - s->base);
+        const char *hit = m ? p + __builtin_ctzll(m) : s->limit;
+        if (hit < s->limit)
+            return hit;
+        p = s->limit;
+    }
+    return s->end;
+}
+
+int set_tokenizer_backend(tokenizer_backend_t backend)
+{
+    if (backend == TOKENIZER_AUTO)
+    {
+#ifdef TOKENIZER_X86
+        __builtin_cpu_init();
+        backend = __builtin_cpu_supports("avx2") ? TOKENIZER_AVX2 : TOKENIZER_SSE2;
+#else
+        backend = TOKENIZER_SCALAR;
+#endif
+    }
+
+    switch (backend)
+    {
+    case TOKENIZER_SCALAR:
+        classify = NULL;
+        break;
+#ifdef TOKENIZER_X86
+    case TOKENIZER_SSE2:
+        classify = classify_sse2;
+        break;
+    case TOKENIZER_AVX2:
+        __builtin_cpu_init();
+        if (!__builtin_cpu_supports("avx2"))
+            return -1;
+        classify = classify_avx2;
+        break;
+#endif
+    default:
+        return -1;
+    }
+
+    active_backend = backend;
+    backend_ready = 1;
+    DEBUG_VERBOSE("Tokenizer backend: %s", tokenizer_backend_name());
+    return 0;
+}
+
+const char *tokenizer_backend_name(void)
+{
+    switch (active_backend)
+    {
+    case TOKENIZER_SCALAR:
+        return "scalar";
+    case TOKENIZER_SSE2:
+        return "sse2";
+    case TOKENIZER_AVX2:
+        return "avx2";
+    default:
+        return "auto";
+    }
+}
+
+// =================================================================
+// Token buffer
+// =================================================================
+
+void token_buf_init(token_buf_t *buf)
+{
+    buf->tokens = buf->inline_tokens;
+    buf->count = 0;
+    buf->cap = TOKEN_INLINE;
+}
+
+void token_buf_free(token_buf_t *buf)
+{
+    if (buf->tokens != buf->inline_tokens)
+        free(buf->tokens);
+    token_buf_init(buf);
+}
+
+static token_t *push_token(token_buf_t *buf)
+{
+    if (buf->count == buf->cap)
+    {
+        int new_cap = buf->cap * 2;
+        token_t *grown;
+
+        if (buf->tokens == buf->inline_tokens)
+        {
+            grown = malloc(new_cap * sizeof(token_t));
+            if (grown)
+                memcpy(grown, buf->tokens, buf->count * sizeof(token_t));
+        }
+        else
+        {
+            grown = realloc(buf->tokens, new_cap * sizeof(token_t));
+        }
+
+        if (!grown)
+        {
+            DEBUG_ERROR("tokenize: out of memory at %d tokens", buf->count);
+            return NULL;
+        }
+        buf->tokens = grown;
+        buf->cap = new_cap;
+    }
+
+    return &buf->tokens[buf->count++];
+}
+
+// =================================================================
+// Tokenizer
+// =================================================================
+
+static int tokenize_line(const char *input, token_buf_t *buf)
+{
+    buf->count = 0;
+
+    const char *pos = input;
+    const char *end = input + strlen(input);
+    scanner_t scan = {end, NULL, NULL, 0, 0};
+
+    while (1)
+    {
+        // Skip whitespace (usually a single blank, so check before scanning)
+        if (pos < end && (byte_class[(unsigned char)*pos] & CLASS_SPACE))
+            pos = scan_nonspace(&scan, pos);
+        if (pos >= end)
+            break;
+
+        token_t *token = push_token(buf);
+        if (!token)
+            return -1;
+        token->start = pos;
+        token->len = 1;
+
+        // pos[1] is safe to read: input is NUL-terminated
+        // Check for redirection operators (order matters! very important )
+        char next = pos[1];
+        switch (*pos)
+        {
+        case '&':
+            if (next == '&')
+            {
+                token->type = TOKEN_AND;
+                token->len = 2;
+            }
+            else if (next == '>')
+            {
+                token->type = TOKEN_REDIRECT_BOTH;
+                token->len = 2;
+            }
+            else
+            {
+                token->type = TOKEN_BACKGROUND;
+            }
+            break;
+        case '|':
+            if (next == '|')
+            {
+                token->type = TOKEN_OR;
+                token->len = 2;
+            }
+            else
+            {
+                token->type = TOKEN_PIPE;
+            }
+            break;
+        case '>':
+            if (next == '>')
+            {
+                token->type = TOKEN_REDIRECT_APPEND;
+                token->len = 2;
+            }
+            else
+            {
+                token->type = TOKEN_REDIRECT_OUT;
+            }
+            break;
+        case '<':
+            token->type = TOKEN_REDIRECT_IN;
+            break;
+        case ';':
+            token->type = TOKEN_SEMICOLON;
+            break;
+        case '(':
+            token->type = TOKEN_LPAREN;
+            break;
+        case ')':
+            token->type = TOKEN_RPAREN;
+            break;
+        case '2':
+            if (next == '>')
+            {
+                token->type = TOKEN_REDIRECT_ERR;
+                token->len = 2;
+                break;
+            }
+            /* fall through */
+        default:
+        {
+            // Word: runs until whitespace or an operator, but quoted parts
+            // ("a b", 'x|y') are part of the word. Unclosed quotes are literal.
+            token->type = TOKEN_WORD;
+            const char *p = pos;
+            while (1)
+            {
+                p = scan_special(&scan, p);
+                if (p < end && (byte_class[(unsigned char)*p] & CLASS_QUOTE))
+                {
+                    const char *close = memchr(p + 1, *p, end - p - 1);
+                    p = close ? close + 1 : p + 1;
+                    continue;
+                }
+                break;
+            }
+            token->len = p - pos;
+            break;
+        }
+        }
+
+        pos += token->len;
+    }
+
+    // EOF token
+    token_t *eof = push_token(buf);
+    if (!eof)
+        return -1;
+    eof->type = TOKEN_EOF;
+    eof->start = NULL;
+    eof->len = 0;
+
+    return 0;
+}
+
+int tokenize(const char *input, token_buf_t *buf)
+{
+    if (!backend_ready)
+        set_tokenizer_backend(TOKENIZER_AUTO);
+
+    uint64_t span = TRACE_BEGIN();
+    int result = tokenize_line(input, buf);
+    TRACE_END(span, "tokenize", input);
+    return result;
+}
@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include "trace.h"
+
+typedef struct {
+    atomic_ulong seq;               // index + 1 once the slot is complete
+    const char *name;               // static string
+    char detail[TRACE_DETAIL_MAX];
+    uint64_t start_ns;
+    uint64_t dur_ns;
+} trace_span_t;
+
+int trace_enabled = 0;
+
+static trace_span_t trace_ring[TRACE_RING_SIZE];
+static atomic_ulong trace_head = 0;     // next index to claim
+static uint64_t trace_origin_ns = 0;    // trace start, ts 0 in the dump
+
+uint64_t trace_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+// Lock-free: claim an index, fill the slot, publish it with seq last.
+// Spans are only recorded on the main thread (the prompt worker records
+// none) and trace_dump runs there too, so a dump never races a writer.
+void trace_record(const char *name, const char *detail, uint64_t start) {
+    uint64_t end = trace_now_ns();
+    unsigned long index = atomic_fetch_add_explicit(&trace_head, 1, memory_order_relaxed);
+    trace_span_t *span = &trace_ring[index & (TRACE_RING_SIZE - 1)];
+
+    atomic_store_explicit(&span->seq, 0, memory_order_relaxed);
+    span->name = name;
+    snprintf(span->detail, sizeof(span->detail), "%s", detail ? detail : "");
+    span->start_ns = start;
+    span->dur_ns = end - start;
+    atomic_store_explicit(&span->seq, index + 1, memory_order_release);
+}
+
+void trace_start(void) {
+    atomic_store(&trace_head, 0);
+    for (int i = 0; i < TRACE_RING_SIZE; i++) {
+        atomic_store_explicit(&trace_ring[i].seq, 0, memory_order_relaxed);
+    }
+    trace_origin_ns = trace_now_ns();
+    trace_enabled = 1;
+}
+
+void trace_stop(void) {
+    trace_enabled = 0;
+}
+
+void trace_stats(unsigned long *recorded, unsigned long *overwritten) {
+    unsigned long head = atomic_load(&trace_head);
+    if (recorded) *recorded = head;
+    if (overwritten) *overwritten = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+}
+
+static void write_json_string(FILE *out, const char *text) {
+    fputc('"', out);
+    for (const unsigned char *c = (const unsigned char *)text; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(out, "\\%c", *c);
+        } else if (*c < 0x20) {
+            fprintf(out, "\\u%04x", *c);
+        } else {
+            fputc(*c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+int trace_dump(const char *path) {
+    FILE *out = fopen(path, "w");
+    if (!out) return -1;
+
+    unsigned long head = atomic_load_explicit(&trace_head, memory_order_acquire);
+    unsigned long first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+    int pid = getpid();
+    int wrote = 0;
+
+    fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (unsigned long i = first; i < head; i++) {
+        trace_span_t *span = &trace_ring[i & (TRACE_RING_SIZE - 1)];
+        if (atomic_load_explicit(&span->seq, memory_order_acquire) != i + 1) {
+            continue;   // being written, or already reused
+        }
+
+        // Complete events ("X"), microseconds from trace start
+        fprintf(out, "%s{\"name\":\"%s\",\"cat\":\"nutshell\",\"ph\":\"X\","
+                     "\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d",
+                wrote ? ",\n" : "", span->name,
+                (double)(span->start_ns - trace_origin_ns) / 1000.0,
+                span->dur_ns / 1000.0, pid, pid);
+        if (span->detail[0]) {
+            fprintf(out, ",\"args\":{\"detail\":");
+            write_json_string(out, span->detail);
+            fputc('}', out);
+        }
+        fputc('}', out);
+        wrote++;
+    }
+    fprintf(out, "\n]}\n");
+
+    return fclose(out) == 0 ? 0 : -1;
+}
@@ -4,108 +4,302 @@
 #include <unistd.h>
 #include <pwd.h>
 #include "utils.h"
+#include "variables.h"
+#include "prompt_async.h"
+#include "debug.h"
 
-// Simple current directory prompt
-char* get_simple_prompt() {
-    static char prompt[1024];
-    char cwd[512];
-    
-    if (getcwd(cwd, sizeof(cwd)) != NULL) {
-        snprintf(prompt, sizeof(prompt), "nutshell:%s> ", cwd);
-    } else {
-        strcpy(prompt, "nutshell> ");
-    }
-    
-    return prompt;
+// =================================================================
+// Prompt engine
+// =================================================================
+//
+// PROMPT is compiled once into segments: literal runs and escapes like
+// \w or \h. Values the escapes need are cached: user and host at
+// startup, cwd at startup and after each cdir. A prompt is only rebuilt
+// when the template or something a segment shows changed, and then only
+// those segments are re-rendered. \g is slow (git status), so it comes
+// from prompt_async.c: cached per directory, refreshed on a worker thread.
+
+typedef enum {
+    SEG_TEXT,           // literal run, escapes like \n \e \[ already resolved
+    SEG_USER,           // \u
+    SEG_HOST,           // \h  hostname up to the first '.'
+    SEG_HOST_FULL,      // \H
+    SEG_CWD,            // \w  cwd, $HOME shown as ~
+    SEG_CWD_BASE,       // \W  last component of \w
+    SEG_PROMPT_CHAR,    // \$  # for root, $ otherwise
+    SEG_STATUS,         // \?  last exit status
+    SEG_DURATION,       // \d  how long the last command line took
+    SEG_GIT             // \g  git branch, * if dirty (async)
+} segment_kind_t;
+
+typedef struct {
+    segment_kind_t kind;
+    char *text;             // literal, or the value last rendered
+    size_t len;
+    unsigned long gen;      // segment_gen() the text was rendered at
+} prompt_segment_t;
+
+typedef struct {
+    char *source;           // PROMPT it was compiled from
+    prompt_segment_t segments[PROMPT_SEGMENTS_MAX];
+    int count;
+    char rendered[PROMPT_MAX];
+    int rendered_valid;
+    unsigned long rendered_gen;
+} prompt_template_t;
+
+static prompt_template_t prompt_template;
+
+// Cached inputs
+static char prompt_user[256] = "user";
+static char prompt_host[256] = "localhost";
+static char prompt_cwd[PROMPT_MAX] = "";
+static char *prompt_home = NULL;        // HOME the cwd was shortened with
+static int prompt_is_root = 0;
+static unsigned long cwd_gen = 1;       // bumped when \w / \W would change
+static unsigned long command_gen = 0;   // bumped after every command line
+static double last_duration = 0;
+
+void init_prompt(void) {
+    const char *user = get_variable("USER");
+    if (!user) {
+        struct passwd *pw = getpwuid(geteuid());
+        user = pw ? pw->pw_name : NULL;
+    }
+    if (user) {
+        snprintf(prompt_user, sizeof(prompt_user), "%s", user);
+    }
+
+    if (gethostname(prompt_host, sizeof(prompt_host)) != 0) {
+        strcpy(prompt_host, "localhost");
+    }
+    prompt_host[sizeof(prompt_host) - 1] = '\0';
+    prompt_is_root = geteuid() == 0;
+
+    prompt_cwd_changed();
 }
 
-// Bash-style prompt with home directory shortening
-char* get_fancy_prompt() {
-    static char prompt[1024];
-    char cwd[512];
-    char *home_dir = getenv("HOME");
-    
-    if (getcwd(cwd, sizeof(cwd)) != NULL) {
-        char display_path[512];
-        
-        // Replace home directory with ~
-        if (home_dir && strncmp(cwd, home_dir, strlen(home_dir)) == 0) {
-            if (strlen(cwd) == strlen(home_dir)) {
-                strcpy(display_path, "~");
-            } else {
-                snprintf(display_path, sizeof(display_path), "~%s", cwd + strlen(home_dir));
+void prompt_cwd_changed(void) {
+    if (getcwd(prompt_cwd, sizeof(prompt_cwd)) == NULL) {
+        strcpy(prompt_cwd, "?");
+    }
+    cwd_gen++;
+}
+
+void prompt_command_finished(double seconds) {
+    last_duration = seconds;
+    command_gen++;
+    async_segments_invalidate();    // the command may have changed the repo
+}
+
+// What a segment's text depends on; a counter sum changes when any does
+static unsigned long segment_gen(segment_kind_t kind) {
+    switch (kind) {
+        case SEG_CWD:
+        case SEG_CWD_BASE:
+            return cwd_gen;
+        case SEG_STATUS:
+        case SEG_DURATION:
+            return command_gen;
+        case SEG_GIT:
+            return cwd_gen + command_gen + async_segments_gen();
+        default:
+            return 0;
+    }
+}
+
+static unsigned long prompt_gen(void) {
+    return cwd_gen + command_gen + async_segments_gen();
+}
+
+// HOME is a variable like any other: if it changed, so does \w
+static void check_home(void) {
+    const char *home = get_variable("HOME");
+
+    if ((home == NULL) != (prompt_home == NULL) ||
+        (home && strcmp(home, prompt_home) != 0)) {
+        free(prompt_home);
+        prompt_home = home ? strdup(home) : NULL;
+        cwd_gen++;
+    }
+}
+
+static void add_segment(prompt_template_t *tpl, segment_kind_t kind, const char *text, size_t len) {
+    if (tpl->count == PROMPT_SEGMENTS_MAX) {
+        return;
+    }
+
+    prompt_segment_t *seg = &tpl->segments[tpl->count++];
+    seg->kind = kind;
+    seg->text = NULL;
+    seg->len = 0;
+    seg->gen = 0;
+    if (kind == SEG_TEXT) {
+        seg->text = strndup(text, len);
+        seg->len = seg->text ? len : 0;
+    }
+}
+
+static void free_template(prompt_template_t *tpl) {
+    for (int i = 0; i < tpl->count; i++) {
+        free(tpl->segments[i].text);
+    }
+    free(tpl->source);
+    memset(tpl, 0, sizeof(*tpl));
+}
+
+// PS1-style escapes: \u \h \H \w \W \$ make segments, \n \e \a \\ \[ \]
+// become literal bytes (\[ \] are readline's \001 \002 around colors)
+static void compile_template(prompt_template_t *tpl, const char *source) {
+    char literal[PROMPT_MAX];
+    size_t lit_len = 0;
+
+    free_template(tpl);
+    tpl->source = strdup(source);
+
+    for (const char *p = source; *p; p++) {
+        char byte = *p;
+        segment_kind_t kind = SEG_TEXT;
+
+        if (*p == '\\' && p[1]) {
+            p++;
+            switch (*p) {
+                case 'u': kind = SEG_USER; break;
+                case 'h': kind = SEG_HOST; break;
+                case 'H': kind = SEG_HOST_FULL; break;
+                case 'w': kind = SEG_CWD; break;
+                case 'W': kind = SEG_CWD_BASE; break;
+                case '$': kind = SEG_PROMPT_CHAR; break;
+                case '?': kind = SEG_STATUS; break;
+                case 'd': kind = SEG_DURATION; break;
+                case 'g': kind = SEG_GIT; break;
+                case 'n': byte = '\n'; break;
+                case 'e': byte = '\033'; break;
+                case 'a': byte = '\a'; break;
+                case '[': byte = '\001'; break;
+                case ']': byte = '\002'; break;
+                case '\\': byte = '\\'; break;
+                default:
+                    // Unknown escape: keep it as typed
+                    if (lit_len < sizeof(literal) - 1) literal[lit_len++] = '\\';
+                    byte = *p;
+                    break;
             }
-        } else {
-            strcpy(display_path, cwd);
         }
-        
-        snprintf(prompt, sizeof(prompt), "nutshell:%s> ", display_path);
-    } else {
-        strcpy(prompt, "nutshell> ");
+
+        if (kind != SEG_TEXT) {
+            if (lit_len) add_segment(tpl, SEG_TEXT, literal, lit_len);
+            lit_len = 0;
+            add_segment(tpl, kind, "", 0);
+        } else if (lit_len < sizeof(literal) - 1) {
+            literal[lit_len++] = byte;
+        }
+    }
+    if (lit_len) add_segment(tpl, SEG_TEXT, literal, lit_len);
+
+    // The worker thread only exists once a prompt wants it
+    for (int i = 0; i < tpl->count; i++) {
+        if (tpl->segments[i].kind == SEG_GIT) async_segments_init();
     }
-    
-    return prompt;
+
+    DEBUG_VERBOSE("Prompt template compiled into %d segments", tpl->count);
 }
 
-// Full bash-style with username and hostname
-char* get_full_prompt() {
-    static char prompt[1024];
-    char cwd[512];
-    char hostname[256];
-    char *username = getenv("USER");
-    char *home_dir = getenv("HOME");
-    
-    if (getcwd(cwd, sizeof(cwd)) == NULL) {
-        strcpy(cwd, "unknown");
-    }
-    
-    if (gethostname(hostname, sizeof(hostname)) != 0) {
-        strcpy(hostname, "localhost");
-    }
-    
-    // Shorten home directory to ~
-    char display_path[512];
-    if (home_dir && strncmp(cwd, home_dir, strlen(home_dir)) == 0) {
-        if (strlen(cwd) == strlen(home_dir)) {
-            strcpy(display_path, "~");
-        } else {
-            snprintf(display_path, sizeof(display_path), "~%s", cwd + strlen(home_dir));
-        }
-    } else {
-        strcpy(display_path, cwd);
-    }
-    
-    snprintf(prompt, sizeof(prompt), "%s@%s:%s$ ", 
-             username ? username : "user", hostname, display_path);
-    
-    return prompt;
+// \w: cwd with a leading $HOME replaced by ~
+static const char* display_cwd(char *buf, size_t size) {
+    size_t home_len = prompt_home ? strlen(prompt_home) : 0;
+
+    if (home_len > 1 && strncmp(prompt_cwd, prompt_home, home_len) == 0 &&
+        (prompt_cwd[home_len] == '\0' || prompt_cwd[home_len] == '/')) {
+        snprintf(buf, size, "~%s", prompt_cwd + home_len);
+        return buf;
+    }
+    return prompt_cwd;
 }
 
-// Colored prompt 
-char* get_colored_prompt() {
-    static char prompt[1024];
-    char cwd[512];
-    char *home_dir = getenv("HOME");
-    
-    if (getcwd(cwd, sizeof(cwd)) != NULL) {
-        char display_path[512];
-        
-        if (home_dir && strncmp(cwd, home_dir, strlen(home_dir)) == 0) {
-            if (strlen(cwd) == strlen(home_dir)) {
-                strcpy(display_path, "~");
+static void render_segment(prompt_segment_t *seg) {
+    char buf[PROMPT_MAX];
+    const char *value = "";
+
+    switch (seg->kind) {
+        case SEG_TEXT:
+            return;
+        case SEG_USER:
+            value = prompt_user;
+            break;
+        case SEG_HOST:
+            snprintf(buf, sizeof(buf), "%.*s", (int)strcspn(prompt_host, "."), prompt_host);
+            value = buf;
+            break;
+        case SEG_HOST_FULL:
+            value = prompt_host;
+            break;
+        case SEG_CWD:
+            value = display_cwd(buf, sizeof(buf));
+            break;
+        case SEG_CWD_BASE: {
+            const char *cwd = display_cwd(buf, sizeof(buf));
+            const char *slash = strrchr(cwd, '/');
+            value = (slash && slash[1]) ? slash + 1 : cwd;
+            break;
+        }
+        case SEG_PROMPT_CHAR:
+            value = prompt_is_root ? "#" : "$";
+            break;
+        case SEG_STATUS:
+            snprintf(buf, sizeof(buf), "%d", get_last_status());
+            value = buf;
+            break;
+        case SEG_DURATION:
+            if (last_duration < 1) {
+                snprintf(buf, sizeof(buf), "%dms", (int)(last_duration * 1000));
+            } else if (last_duration < 60) {
+                snprintf(buf, sizeof(buf), "%.1fs", last_duration);
             } else {
-                snprintf(display_path, sizeof(display_path), "~%s", cwd + strlen(home_dir));
+                snprintf(buf, sizeof(buf), "%dm%02ds", (int)last_duration / 60, (int)last_duration % 60);
             }
-        } else {
-            strcpy(display_path, cwd);
+            value = buf;
+            break;
+        case SEG_GIT:
+            value = async_segment_get(ASYNC_GIT, prompt_cwd);
+            break;
+    }
+
+    free(seg->text);
+    seg->text = strdup(value);
+    seg->len = seg->text ? strlen(seg->text) : 0;
+    seg->gen = segment_gen(seg->kind);
+}
+
+const char* render_prompt(void) {
+    const char *source = get_variable("PROMPT");
+    if (!source) {
+        source = DEFAULT_PROMPT;
+    }
+
+    prompt_template_t *tpl = &prompt_template;
+    if (!tpl->source || strcmp(tpl->source, source) != 0) {
+        compile_template(tpl, source);
+    }
+
+    check_home();
+    if (tpl->rendered_valid && tpl->rendered_gen == prompt_gen()) {
+        return tpl->rendered;   // nothing changed since last time
+    }
+
+    size_t len = 0;
+    for (int i = 0; i < tpl->count; i++) {
+        prompt_segment_t *seg = &tpl->segments[i];
+        if (seg->kind != SEG_TEXT && (!seg->text || seg->gen != segment_gen(seg->kind))) {
+            render_segment(seg);
+        }
+        if (seg->text && len + seg->len < sizeof(tpl->rendered)) {
+            memcpy(tpl->rendered + len, seg->text, seg->len);
+            len += seg->len;
         }
-        
-        // Green nutshell, blue path, reset color
-        snprintf(prompt, sizeof(prompt), 
-                "\033[32mnutshell\033[0m:\033[34m%s\033[0m> ", display_path);
-    } else {
-        strcpy(prompt, "\033[32mnutshell\033[0m> ");
-    }
-    
-    return prompt;
+    }
+    tpl->rendered[len] = '\0';
+    tpl->rendered_valid = 1;
+    tpl->rendered_gen = prompt_gen();
+    return tpl->rendered;
 }
@@ -5,35 +5,181 @@
 #include "variables.h"
 #include <ctype.h>
 #include "debug.h"
+#include "pathcache.h"
+#include "trace.h"
+
+extern char **environ;
 
 
 static var_table_t var_table;
 
-// Simple hash function
-static unsigned int hash_function(const char *str) {
+// envp handed to spawned programs, rebuilt only after exports change
+static char **env_snapshot = NULL;
+static int env_dirty = 1;
+
+// @? : exit status of the last command, kept as text for expansion
+static int last_status = 0;
+static char last_status_text[12] = "0";
+
+// =================================================================
+// Variable table
+// =================================================================
+
+// djb2 over the full name; 0 is reserved for empty slots
+static unsigned int hash_name(const char *str, size_t *len_out) {
     unsigned int hash = 5381;
+    const char *p = str;
     int c;
-    
-    while ((c = *str++)) {
+
+    while ((c = (unsigned char)*p++)) {
         hash = ((hash << 5) + hash) + c; // hash * 33 + c
     }
-    
-    return hash % HASH_TABLE_SIZE;
+
+    *len_out = p - str - 1;
+    return hash ? hash : 1;
+}
+
+static const char* var_name(const variable_t *var) {
+    return var->name_len < VAR_INLINE_NAME ? var->name.inline_name : var->name.heap_name;
+}
+
+static size_t probe_distance(unsigned int hash, size_t pos) {
+    return (pos - (hash & (var_table.slot_cap - 1))) & (var_table.slot_cap - 1);
+}
+
+// Returns the slot position holding name, or -1
+static long find_slot(const char *name, unsigned int hash, size_t len) {
+    if (!var_table.slots) return -1;
+
+    size_t mask = var_table.slot_cap - 1;
+    size_t pos = hash & mask;
+
+    for (size_t dist = 0; ; dist++, pos = (pos + 1) & mask) {
+        var_slot_t *slot = &var_table.slots[pos];
+        if (slot->hash == 0) return -1;
+
+        // Robin Hood invariant: we'd have been placed before a richer slot
+        if (probe_distance(slot->hash, pos) < dist) return -1;
+
+        if (slot->hash == hash) {
+            variable_t *var = &var_table.entries[slot->entry];
+            if (var->name_len == len && memcmp(var_name(var), name, len) == 0)
+                return (long)pos;
+        }
+    }
+}
+
+static void insert_slot(unsigned int hash, unsigned int entry) {
+    size_t mask = var_table.slot_cap - 1;
+    size_t pos = hash & mask;
+    var_slot_t incoming = {hash, entry};
+    size_t dist = 0;
+
+    while (var_table.slots[pos].hash != 0) {
+        size_t existing = probe_distance(var_table.slots[pos].hash, pos);
+        if (existing < dist) {
+            // Take from the rich, keep placing the displaced slot
+            var_slot_t displaced = var_table.slots[pos];
+            var_table.slots[pos] = incoming;
+            incoming = displaced;
+            dist = existing;
+        }
+        pos = (pos + 1) & mask;
+        dist++;
+    }
+
+    var_table.slots[pos] = incoming;
+}
+
+// Backward-shift deletion, so lookups never need tombstones in the index
+static void remove_slot(size_t pos) {
+    size_t mask = var_table.slot_cap - 1;
+    size_t next = (pos + 1) & mask;
+
+    while (var_table.slots[next].hash != 0 &&
+           probe_distance(var_table.slots[next].hash, next) > 0) {
+        var_table.slots[pos] = var_table.slots[next];
+        pos = next;
+        next = (next + 1) & mask;
+    }
+
+    var_table.slots[pos].hash = 0;
+}
+
+// Drop unset entries (keeping order) and rebuild the index at slot_cap
+static int rebuild_table(size_t slot_cap) {
+    var_slot_t *slots = calloc(slot_cap, sizeof(var_slot_t));
+    if (!slots) return -1;
+
+    size_t kept = 0;
+    for (size_t i = 0; i < var_table.entry_count; i++) {
+        if (var_table.entries[i].value)
+            var_table.entries[kept++] = var_table.entries[i];
+    }
+
+    free(var_table.slots);
+    var_table.slots = slots;
+    var_table.slot_cap = slot_cap;
+    var_table.entry_count = kept;
+    var_table.live = kept;
+
+    for (size_t i = 0; i < kept; i++)
+        insert_slot(var_table.entries[i].hash, i);
+
+    DEBUG_VERBOSE("Variable table rebuilt: %zu vars, %zu slots", kept, slot_cap);
+    return 0;
+}
+
+// Make room for one more entry, growing at 3/4 load
+static int reserve_entry(void) {
+    if (var_table.entry_count == var_table.entry_cap) {
+        // Lots of unset tombstones: compacting is enough
+        if (var_table.entry_count - var_table.live >= var_table.entry_cap / 2) {
+            if (rebuild_table(var_table.slot_cap) != 0) return -1;
+        } else {
+            size_t new_cap = var_table.entry_cap * 2;
+            variable_t *grown = realloc(var_table.entries, new_cap * sizeof(variable_t));
+            if (!grown) return -1;
+            var_table.entries = grown;
+            var_table.entry_cap = new_cap;
+        }
+    }
+
+    if ((var_table.live + 1) * 4 > var_table.slot_cap * 3)
+        return rebuild_table(var_table.slot_cap * 2);
+    return 0;
+}
+
+static void free_entry(variable_t *var) {
+    if (var->name_len >= VAR_INLINE_NAME)
+        free(var->name.heap_name);
+    free(var->value);
+    var->value = NULL;
 }
 
 void init_variables(void) {
-    // Initialize hash table
-    for (int i = 0; i < HASH_TABLE_SIZE; i++) {
-        var_table.buckets[i] = NULL;
+    var_table.slot_cap = VAR_TABLE_MIN_SLOTS;
+    var_table.slots = calloc(var_table.slot_cap, sizeof(var_slot_t));
+    var_table.live = 0;
+    var_table.entry_cap = VAR_TABLE_MIN_SLOTS / 2;
+    var_table.entries = malloc(var_table.entry_cap * sizeof(variable_t));
+    var_table.entry_count = 0;
+    if (!var_table.slots || !var_table.entries) {
+        DEBUG_ERROR("Out of memory creating variable table");
+        return;
     }
     
-    // Import common environment variables
-    char *env_vars[] = {"PATH", "HOME", "USER", "PWD", "SHELL", NULL};
-    for (int i = 0; env_vars[i]; i++) {
-        char *value = getenv(env_vars[i]);
-        if (value) {
-            set_variable(env_vars[i], value, 1);  // 1 = exported
-        }
+    // Import the whole environment; from here on the table is the only
+    // copy and environ is never touched again
+    for (char **env = environ; env && *env; env++) {
+        const char *equals = strchr(*env, '=');
+        if (!equals || equals == *env || equals - *env >= MAX_VAR_NAME)
+            continue;
+
+        char name[MAX_VAR_NAME];
+        memcpy(name, *env, equals - *env);
+        name[equals - *env] = '\0';
+        set_variable(name, equals + 1, 1);  // 1 = exported
     }
     
     // Set current working directory
@@ -43,179 +189,389 @@ void init_variables(void) {
     }
 }
 
+// Cached command paths are only valid for the PATH they were found in
+static void invalidate_path_cache(const char *name, const char *old_value, const char *new_value) {
+    if (strcmp(name, "PATH") != 0) return;
+    if (old_value && new_value && strcmp(old_value, new_value) == 0) return;
+
+    DEBUG_INFO("PATH changed, clearing command hash table");
+    path_cache_clear();
+}
+
 int set_variable(const char *name, const char *value, int export_flag) {
-    if (!name || !value) return -1;
+    if (!name || !value || !var_table.slots) return -1;
     
-    unsigned int hash = hash_function(name);
-    variable_t *var = var_table.buckets[hash];
+    size_t len;
+    unsigned int hash = hash_name(name, &len);
+
+    // value may point at the current value (export NAME), copy first
+    char *copy = strdup(value);
+    if (!copy) return -1;
     
-    // Check if variable already exists
-    while (var) {
-        if (strcmp(var->name, name) == 0) {
-            // Update existing variable
-            free(var->value);
-            var->value = strdup(value);
-            var->is_exported = export_flag;
-            
-            // Update environment if exported
-            if (export_flag) {
-                setenv(name, value, 1);
+    long pos = find_slot(name, hash, len);
+    if (pos >= 0) {
+        // Update existing variable
+        variable_t *var = &var_table.entries[var_table.slots[pos].entry];
+        invalidate_path_cache(name, var->value, copy);
+        free(var->value);
+        var->value = copy;
+
+        // Once exported, plain assignments keep it exported (like sh)
+        if (var->is_exported) env_dirty = 1;
+        var->is_exported |= export_flag;
+    } else {
+        // Create new variable
+        if (reserve_entry() != 0) {
+            free(copy);
+            return -1;
+        }
+
+        variable_t *var = &var_table.entries[var_table.entry_count];
+        if (len < VAR_INLINE_NAME) {
+            memcpy(var->name.inline_name, name, len + 1);
+        } else {
+            var->name.heap_name = strdup(name);
+            if (!var->name.heap_name) {
+                free(copy);
+                return -1;
             }
-            return 0;
         }
-        var = var->next;
-    }
-    
-    // Create new variable
-    variable_t *new_var = malloc(sizeof(variable_t));
-    if (!new_var) return -1;
-    
-    new_var->name = strdup(name);
-    new_var->value = strdup(value);
-    new_var->is_exported = export_flag;
-    new_var->next = var_table.buckets[hash];
-    var_table.buckets[hash] = new_var;
-    
-    // Add to environment if exported
-    if (export_flag) {
-        setenv(name, value, 1);
+        var->value = copy;
+        var->hash = hash;
+        var->name_len = len;
+        var->is_exported = export_flag;
+
+        invalidate_path_cache(name, NULL, copy);
+        insert_slot(hash, var_table.entry_count++);
+        var_table.live++;
     }
     
+    if (export_flag) env_dirty = 1;
     return 0;
 }
 
 char* get_variable(const char *name) {
     if (!name) return NULL;
     
-    unsigned int hash = hash_function(name);
-    variable_t *var = var_table.buckets[hash];
-    
-    while (var) {
-        if (strcmp(var->name, name) == 0) {
-            return var->value;
-        }
-        var = var->next;
-    }
+    size_t len;
+    unsigned int hash = hash_name(name, &len);
+    long pos = find_slot(name, hash, len);
+    if (pos >= 0)
+        return var_table.entries[var_table.slots[pos].entry].value;
     
-    // If not found in our table, check environment
-    return getenv(name);
+    return NULL;
 }
 
 int unset_variable(const char *name) {
     if (!name) return -1;
     
-    unsigned int hash = hash_function(name);
-    variable_t *var = var_table.buckets[hash];
-    variable_t *prev = NULL;
+    size_t len;
+    unsigned int hash = hash_name(name, &len);
+    long pos = find_slot(name, hash, len);
+    if (pos < 0) return -1;  // Variable not found
+
+    variable_t *var = &var_table.entries[var_table.slots[pos].entry];
     
-    while (var) {
-        if (strcmp(var->name, name) == 0) {
-            // Remove from hash table
-            if (prev) {
-                prev->next = var->next;
-            } else {
-                var_table.buckets[hash] = var->next;
-            }
-            
-            // Remove from environment if exported
-            if (var->is_exported) {
-                unsetenv(name);
-            }
-            
-            free(var->name);
-            free(var->value);
-            free(var);
+    if (var->is_exported) env_dirty = 1;
+    invalidate_path_cache(name, var->value, NULL);
+
+    // The entry stays as a tombstone so insertion order is kept
+    free_entry(var);
+    remove_slot(pos);
+    var_table.live--;
+    return 0;
+}
+
+// Check if a word is a variable assignment (NAME=value)
+int is_assignment(const char *str) {
+    if (!str)
+        return 0;
+
+    // Looking for VAR=VALUE pattern
+    const char *equals = strchr(str, '=');
+    if (!equals || equals == str)
+        return 0; // No = or starts with = (Should have = atleast)
+
+    // Check that everything before = is a valid variable name
+    for (const char *p = str; p < equals; p++) {
+        if (!isalnum((unsigned char)*p) && *p != '_')
             return 0;
+    }
+
+    return 1;
+}
+
+// Apply an already expanded NAME=value word (shell-local, not exported)
+int assign_variable(const char *assignment) {
+    const char *equals = strchr(assignment, '=');
+    if (!equals) return -1;
+
+    size_t name_len = equals - assignment;
+    if (name_len >= MAX_VAR_NAME) return -1;
+
+    char name[MAX_VAR_NAME];
+    memcpy(name, assignment, name_len);
+    name[name_len] = '\0';
+
+    DEBUG_INFO("Set variable %s = '%s'", name, equals + 1);
+    return set_variable(name, equals + 1, 0);
+}
+
+void set_last_status(int status) {
+    last_status = status;
+    snprintf(last_status_text, sizeof(last_status_text), "%d", status);
+}
+
+int get_last_status(void) {
+    return last_status;
+}
+
+// Build NAME=value strings for every exported variable. The array and its
+// strings are one allocation, reused until an export changes.
+char** get_environment(void) {
+    if (!env_dirty && env_snapshot)
+        return env_snapshot;
+
+    size_t count = 0;
+    size_t bytes = 0;
+    for (size_t i = 0; i < var_table.entry_count; i++) {
+        const variable_t *var = &var_table.entries[i];
+        if (!var->value || !var->is_exported) continue;
+        count++;
+        bytes += var->name_len + strlen(var->value) + 2;
+    }
+
+    char **envp = malloc((count + 1) * sizeof(char*) + bytes);
+    if (!envp) {
+        DEBUG_ERROR("Out of memory building environment");
+        return env_snapshot;  // stale beats none
+    }
+
+    char *out = (char*)(envp + count + 1);
+    size_t n = 0;
+    for (size_t i = 0; i < var_table.entry_count; i++) {
+        const variable_t *var = &var_table.entries[i];
+        if (!var->value || !var->is_exported) continue;
+
+        size_t value_len = strlen(var->value);
+        envp[n++] = out;
+        memcpy(out, var_name(var), var->name_len);
+        out += var->name_len;
+        *out++ = '=';
+        memcpy(out, var->value, value_len + 1);
+        out += value_len + 1;
+    }
+    envp[n] = NULL;
+
+    free(env_snapshot);
+    env_snapshot = envp;
+    env_dirty = 0;
+    DEBUG_VERBOSE("Environment rebuilt: %zu exported vars", count);
+    return env_snapshot;
+}
+
+// Insertion order, like the shell the variables came from
+void list_variables(int exported_only) {
+    for (size_t i = 0; i < var_table.entry_count; i++) {
+        const variable_t *var = &var_table.entries[i];
+        if (!var->value) continue;
+        if (exported_only && !var->is_exported) continue;
+
+        printf("%s%s=%s\n", exported_only ? "export " : "", var_name(var), var->value);
+    }
+}
+
+// =================================================================
+// Variable expansion
+//
+// Two passes over the input: the first resolves every @NAME / @{NAME}
+// reference and sums the output length, the second copies literal runs
+// and values with memcpy into a buffer of exactly that size.
+// =================================================================
+
+#define EXPAND_INLINE_REFS 16   // references resolved without malloc
+
+typedef struct {
+    const char *start;      // the '@' in the input
+    size_t ref_len;         // bytes of input it replaces
+    const char *value;      // "" when unset (expands to nothing)
+    size_t value_len;
+} var_ref_t;
+
+typedef struct {
+    var_ref_t *refs;
+    int count;
+    int cap;
+    var_ref_t inline_refs[EXPAND_INLINE_REFS];
+} ref_list_t;
+
+static int push_ref(ref_list_t *list, const var_ref_t *ref) {
+    if (list->count == list->cap) {
+        int new_cap = list->cap * 2;
+        var_ref_t *grown;
+        if (list->refs == list->inline_refs) {
+            grown = malloc(new_cap * sizeof(var_ref_t));
+            if (grown)
+                memcpy(grown, list->inline_refs, list->count * sizeof(var_ref_t));
+        } else {
+            grown = realloc(list->refs, new_cap * sizeof(var_ref_t));
         }
-        prev = var;
-        var = var->next;
+        if (!grown) return -1;
+        list->refs = grown;
+        list->cap = new_cap;
     }
-    
-    return -1;  // Variable not found
+    list->refs[list->count++] = *ref;
+    return 0;
 }
 
-void list_variables(void) {
-    for (int i = 0; i < HASH_TABLE_SIZE; i++) {
-        variable_t *var = var_table.buckets[i];
-        while (var) {
-            DEBUG_VERBOSE("%s=%s", var->name, var->value);
-            if (var->is_exported) {
-                DEBUG_VERBOSE(" (exported)");
-            }
-            DEBUG_VERBOSE("\n");
-            var = var->next;
+static int is_name_char(char c) {
+    return isalnum((unsigned char)c) || c == '_';
+}
+
+// Parse the reference at p ('@'). Returns bytes consumed, or 0 if it
+// isn't a reference and the '@' is literal.
+static size_t parse_reference(const char *p, const char **name, size_t *name_len) {
+    if (p[1] == '?') {
+        *name = p + 1;
+        *name_len = 1;
+        return 2;
+    }
+
+    if (p[1] == '{') {
+        if (p[2] == '?' && p[3] == '}') {
+            *name = p + 2;
+            *name_len = 1;
+            return 4;
         }
+        const char *close = strchr(p + 2, '}');
+        if (!close || close == p + 2) return 0;
+        for (const char *c = p + 2; c < close; c++)
+            if (!is_name_char(*c)) return 0;
+        *name = p + 2;
+        *name_len = close - (p + 2);
+        return *name_len + 3;
     }
+
+    const char *c = p + 1;
+    while (is_name_char(*c)) c++;
+    if (c == p + 1) return 0;
+    *name = p + 1;
+    *name_len = c - (p + 1);
+    return *name_len + 1;
 }
 
-// Variable expansion function
-char* expand_variables(const char *input) {
-    if (!input) return NULL;
-    
-    DEBUG_VERBOSE("Expanding: '%s'\n", input);
-    
-    char *result = malloc(strlen(input) * 4 + 1);
-    char *result_ptr = result;
-    const char *input_ptr = input;
-    
-    while (*input_ptr) {
-        DEBUG_VERBOSE("Processing char: '%c'\n", *input_ptr);  // NEW DEBUG
-        
-        if (*input_ptr == '@') {
-            DEBUG_INFO("Found @ symbol\n");  // NEW DEBUG
-            input_ptr++;  // Skip $
-            
-            if (*input_ptr == '{') {
-                // Handle ${VAR} syntax - your existing code
-            } else {
-                // Handle $VAR syntax
-                char var_name[MAX_VAR_NAME];
-                int i = 0;
-                
-                DEBUG_INFO("Collecting variable name starting with: '%c'\n", *input_ptr);  // NEW DEBUG
-                
-                while (*input_ptr && (isalnum(*input_ptr) || *input_ptr == '_') && 
-                       i < MAX_VAR_NAME - 1) {
-                    var_name[i++] = *input_ptr++;
-                    DEBUG_VERBOSE("Added char to var_name: '%c', var_name so far: '%.*s'\n", 
-                           *(input_ptr-1), i, var_name);  // NEW DEBUG
-                }
-                var_name[i] = '\0';
-                
-                DEBUG_VERBOSE("Final variable name: '%s'\n", var_name);  // NEW DEBUG
-                
-                if (i > 0) {
-                    char *var_value = get_variable(var_name);
-                    DEBUG_VERBOSE("Variable $%s = '%s'\n", var_name, var_value ? var_value : "(null)");
-                    if (var_value) {
-                        strcpy(result_ptr, var_value);
-                        result_ptr += strlen(var_value);
-                    }
-                } else {
-                    DEBUG_WARN("No variable name found, keeping $\n");  // NEW DEBUG
-                    *result_ptr++ = '$';
-                }
+// Pass 1: resolve references, return the exact expanded length
+static size_t resolve_references(const char *input, size_t input_len, ref_list_t *list, int *failed) {
+    size_t total = input_len;
+    const char *end = input + input_len;
+    const char *p = input;
+
+    while ((p = memchr(p, '@', end - p)) != NULL) {
+        const char *name;
+        size_t name_len;
+        size_t consumed = parse_reference(p, &name, &name_len);
+        if (consumed == 0) {
+            p++;
+            continue;
+        }
+
+        var_ref_t ref = {p, consumed, "", 0};
+        if (name_len == 1 && name[0] == '?') {
+            ref.value = last_status_text;
+            ref.value_len = strlen(last_status_text);
+        }
+        // Names that can't be stored can't be set either, so they're unset
+        else if (name_len < MAX_VAR_NAME) {
+            char var_name[MAX_VAR_NAME];
+            memcpy(var_name, name, name_len);
+            var_name[name_len] = '\0';
+            const char *value = get_variable(var_name);
+            if (value) {
+                ref.value = value;
+                ref.value_len = strlen(value);
             }
-        } else {
-            *result_ptr++ = *input_ptr++;
         }
+
+        if (push_ref(list, &ref) != 0) {
+            *failed = 1;
+            return 0;
+        }
+        total = total - consumed + ref.value_len;
+        p += consumed;
     }
-    
-    *result_ptr = '\0';
-    DEBUG_INFO ("Expanded result: '%s'\n", result);
+
+    return total;
+}
+
+// Pass 2: stitch literal runs and values together
+static void copy_expanded(const char *input, size_t input_len, const ref_list_t *list, char *result) {
+    char *out = result;
+    const char *in = input;
+
+    for (int i = 0; i < list->count; i++) {
+        const var_ref_t *ref = &list->refs[i];
+        size_t literal = ref->start - in;
+        memcpy(out, in, literal);
+        out += literal;
+        memcpy(out, ref->value, ref->value_len);
+        out += ref->value_len;
+        in = ref->start + ref->ref_len;
+    }
+
+    size_t tail = input + input_len - in;
+    memcpy(out, in, tail);
+    out[tail] = '\0';
+}
+
+// Shared by both entry points; allocates from the arena, or malloc if NULL
+static char* expand_with(const char *input, arena_t *arena) {
+    uint64_t span = TRACE_BEGIN();
+    ref_list_t list;
+    list.refs = list.inline_refs;
+    list.count = 0;
+    list.cap = EXPAND_INLINE_REFS;
+
+    size_t input_len = strlen(input);
+    int failed = 0;
+    size_t total = resolve_references(input, input_len, &list, &failed);
+
+    char *result = NULL;
+    if (!failed)
+        result = arena ? arena_alloc(arena, total + 1) : malloc(total + 1);
+
+    if (result) {
+        copy_expanded(input, input_len, &list, result);
+        DEBUG_VERBOSE("Expanded '%s' -> '%s' (%d refs)", input, result, list.count);
+    } else {
+        DEBUG_ERROR("Out of memory expanding '%s'", input);
+    }
+
+    if (list.refs != list.inline_refs)
+        free(list.refs);
+    TRACE_END(span, "expand", input);
     return result;
 }
 
+char* expand_variables(const char *input) {
+    if (!input) return NULL;
+    return expand_with(input, NULL);
+}
+
+// Same, but the result lives in the per-line arena (no free needed)
+char* expand_variables_arena(const char *input, arena_t *arena) {
+    if (!input) return NULL;
+    return expand_with(input, arena);
+}
+
 void cleanup_variables(void) {
-    for (int i = 0; i < HASH_TABLE_SIZE; i++) {
-        variable_t *var = var_table.buckets[i];
-        while (var) {
-            variable_t *next = var->next;
-            free(var->name);
-            free(var->value);
-            free(var);
-            var = next;
-        }
-        var_table.buckets[i] = NULL;
+    for (size_t i = 0; i < var_table.entry_count; i++) {
+        if (var_table.entries[i].value)
+            free_entry(&var_table.entries[i]);
     }
+    free(var_table.entries);
+    free(var_table.slots);
+    free(env_snapshot);
+    env_snapshot = NULL;
+    env_dirty = 1;
+    memset(&var_table, 0, sizeof(var_table));
 }
@@ -0,0 +1,39 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+#include <string.h>
+
+// Just enough for the tests under tests/: a failed CHECK prints where and
+// carries on, check_summary() prints the tally and gives the exit status.
+
+static int check_total = 0;
+static int check_failed = 0;
+
+#define CHECK(cond) \
+    do { \
+        check_total++; \
+        if (!(cond)) { \
+            check_failed++; \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+        } \
+    } while (0)
+
+#define CHECK_STR(got, want) \
+    do { \
+        const char *got_ = (got); \
+        const char *want_ = (want); \
+        check_total++; \
+        if (!got_ || strcmp(got_, want_) != 0) { \
+            check_failed++; \
+            fprintf(stderr, "%s:%d: %s is \"%s\", want \"%s\"\n", __FILE__, __LINE__, \
+                    #got, got_ ? got_ : "(null)", want_); \
+        } \
+    } while (0)
+
+static inline int check_summary(const char *name) {
+    printf("%-16s %d checks, %d failed\n", name, check_total, check_failed);
+    return check_failed ? 1 : 0;
+}
+
+#endif
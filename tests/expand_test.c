@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "variables.h"
+#include "check.h"
+
+static void check_expand(const char *input, const char *want) {
+    char *got = expand_variables(input);
+    check_total++;
+    if (!got || strcmp(got, want) != 0) {
+        check_failed++;
+        fprintf(stderr, "expand(\"%s\") is \"%s\", want \"%s\"\n",
+                input, got ? got : "(null)", want);
+    }
+    free(got);
+
+    // The arena flavour must give the same text
+    arena_t arena;
+    arena_init(&arena);
+    CHECK_STR(expand_variables_arena(input, &arena), want);
+    arena_destroy(&arena);
+}
+
+static void test_references(void) {
+    set_variable("USER", "alice", 0);
+    set_variable("DIR", "/tmp/x", 0);
+    set_variable("EMPTY", "", 0);
+
+    check_expand("plain text", "plain text");
+    check_expand("", "");
+    check_expand("@USER", "alice");
+    check_expand("hi @USER!", "hi alice!");
+    check_expand("@DIR/@USER.log", "/tmp/x/alice.log");
+    check_expand("@{USER}name", "alicename");
+    check_expand("@USERname", "");              // the name runs on
+    check_expand("@USER@DIR", "alice/tmp/x");
+    check_expand("[@EMPTY]", "[]");
+}
+
+static void test_status(void) {
+    set_last_status(42);
+    check_expand("@?", "42");
+    check_expand("@{?}", "42");
+    check_expand("rc=@?x", "rc=42x");
+    set_last_status(0);
+    check_expand("@?@?", "00");
+}
+
+static void test_unset_and_literal(void) {
+    check_expand("a@NOPE.b", "a.b");
+    check_expand("@{NOPE}", "");
+    check_expand("x @ y", "x @ y");
+    check_expand("trailing@", "trailing@");
+    check_expand("@{", "@{");
+    check_expand("@{}", "@{}");
+    check_expand("@{USER", "@{USER");
+    check_expand("@{US-ER}", "@{US-ER}");
+    check_expand("@-x", "@-x");
+}
+
+static void test_overlong(void) {
+    // A name too long to store can't be set, so it's unset
+    char input[MAX_VAR_NAME + 16];
+    memset(input, 'N', sizeof(input));
+    input[0] = '@';
+    snprintf(input + MAX_VAR_NAME + 1, sizeof(input) - MAX_VAR_NAME - 1, "!");
+    check_expand(input, "!");
+
+    input[0] = '{';
+    char braced[MAX_VAR_NAME + 32];
+    snprintf(braced, sizeof(braced), "@%.*s}!", MAX_VAR_NAME + 1, input);
+    check_expand(braced, "!");
+
+    // Exactly the longest storable name still resolves
+    char name[MAX_VAR_NAME];
+    memset(name, 'L', MAX_VAR_NAME - 1);
+    name[MAX_VAR_NAME - 1] = '\0';
+    CHECK(set_variable(name, "long", 0) == 0);
+    char ref[MAX_VAR_NAME + 8];
+    snprintf(ref, sizeof(ref), "<@%s>", name);
+    check_expand(ref, "<long>");
+}
+
+static void test_many(void) {
+    // More references than fit inline, and a value longer than its reference
+    char input[1024] = "";
+    char want[4096] = "";
+    set_variable("V", "value-longer-than-the-reference", 0);
+    for (int i = 0; i < 40; i++) {
+        strcat(input, "@V,");
+        strcat(want, "value-longer-than-the-reference,");
+    }
+    check_expand(input, want);
+}
+
+int main(void) {
+    init_variables();
+    test_references();
+    test_status();
+    test_unset_and_literal();
+    test_overlong();
+    test_many();
+    cleanup_variables();
+    return check_summary("expand");
+}
@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include "parsers.h"
+#include "check.h"
+
+// Hits and misses since the last call
+static void cache_delta(unsigned long *hits, unsigned long *misses) {
+    static unsigned long last_hits = 0, last_misses = 0;
+    unsigned long h, m;
+    parse_cache_stats(&h, &m);
+    *hits = h - last_hits;
+    *misses = m - last_misses;
+    last_hits = h;
+    last_misses = m;
+}
+
+static parsed_line_t* parse_released(const char *input) {
+    parsed_line_t *line = parse_command_line(input);
+    release_command_line(line);
+    return line;
+}
+
+// Push n distinct lines through the cache
+static void fill_cache(const char *tag, int n) {
+    char input[64];
+    for (int i = 0; i < n; i++) {
+        snprintf(input, sizeof(input), "echo %s %d", tag, i);
+        parse_released(input);
+    }
+}
+
+static void test_hit(void) {
+    unsigned long hits, misses;
+    cache_delta(&hits, &misses);
+
+    parsed_line_t *first = parse_released("ls -l | wc -l && echo done");
+    parsed_line_t *again = parse_released("ls -l | wc -l && echo done");
+    cache_delta(&hits, &misses);
+
+    CHECK(first != NULL);
+    CHECK(first == again);
+    CHECK(misses == 1);
+    CHECK(hits == 1);
+    CHECK(first->ast && first->ast->type == NODE_AND);
+
+    // Only the exact text hits
+    parse_released("ls -l | wc -l &&  echo done");
+    cache_delta(&hits, &misses);
+    CHECK(hits == 0 && misses == 1);
+}
+
+static void test_blank_and_errors(void) {
+    parsed_line_t *blank = parse_released("   ");
+    CHECK(blank != NULL && blank->ast == NULL);
+
+    unsigned long hits, misses;
+    cache_delta(&hits, &misses);
+    CHECK(parse_released("echo a |") == NULL);
+    CHECK(parse_released("echo a |") == NULL);
+    cache_delta(&hits, &misses);
+    CHECK(hits == 0 && misses == 2);    // errors aren't cached
+}
+
+static void test_eviction(void) {
+    clear_parse_cache();
+
+    parse_released("echo oldest");
+    parsed_line_t *kept = parse_released("echo kept");
+    fill_cache("fill", PARSE_CACHE_SIZE - 2);
+
+    // Touch kept so oldest is the least recently used, then overflow by one
+    parse_released("echo kept");
+    fill_cache("more", 1);
+
+    unsigned long hits, misses;
+    cache_delta(&hits, &misses);
+    CHECK(parse_released("echo kept") == kept);
+    cache_delta(&hits, &misses);
+    CHECK(hits == 1 && misses == 0);
+
+    parsed_line_t *reparsed = parse_released("echo oldest");
+    cache_delta(&hits, &misses);
+    CHECK(misses == 1 && hits == 0);
+    CHECK(reparsed != NULL);
+}
+
+static void test_pinned(void) {
+    clear_parse_cache();
+
+    // A line the executor still holds must survive any amount of churn
+    parsed_line_t *pinned = parse_command_line("echo pinned; echo twice");
+    fill_cache("churn", PARSE_CACHE_SIZE * 2);
+
+    unsigned long hits, misses;
+    cache_delta(&hits, &misses);
+    parsed_line_t *again = parse_command_line("echo pinned; echo twice");
+    cache_delta(&hits, &misses);
+    CHECK(again == pinned);
+    CHECK(hits == 1);
+    CHECK(pinned->refs == 2);
+
+    release_command_line(again);
+    release_command_line(pinned);
+    CHECK(pinned->refs == 0);
+
+    // Unpinned it goes like any other line, clear_parse_cache included
+    clear_parse_cache();
+    parse_released("echo pinned; echo twice");
+    cache_delta(&hits, &misses);
+    CHECK(misses == 1);
+}
+
+int main(void) {
+    test_hit();
+    test_blank_and_errors();
+    test_eviction();
+    test_pinned();
+    clear_parse_cache();
+    return check_summary("parse_cache");
+}
@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tokenizer.h"
+#include "check.h"
+
+static const tokenizer_backend_t backends[] = {TOKENIZER_SSE2, TOKENIZER_AVX2};
+static const char *backend_names[] = {"sse2", "avx2"};
+
+// "WORD(echo) 2> WORD(err)": types and texts in one comparable string
+static void describe(const char *input, char *out, size_t size) {
+    static const char *ops[] = {
+        [TOKEN_PIPE] = "|", [TOKEN_BACKGROUND] = "&", [TOKEN_SEMICOLON] = ";",
+        [TOKEN_REDIRECT_OUT] = ">", [TOKEN_REDIRECT_APPEND] = ">>",
+        [TOKEN_REDIRECT_IN] = "<", [TOKEN_REDIRECT_ERR] = "2>",
+        [TOKEN_REDIRECT_BOTH] = "&>", [TOKEN_AND] = "&&", [TOKEN_OR] = "||",
+        [TOKEN_LPAREN] = "(", [TOKEN_RPAREN] = ")",
+    };
+    token_buf_t buf;
+    token_buf_init(&buf);
+    size_t len = 0;
+    out[0] = '\0';
+
+    if (tokenize(input, &buf) != 0) {
+        snprintf(out, size, "(out of memory)");
+        token_buf_free(&buf);
+        return;
+    }
+    for (int i = 0; i < buf.count && len < size; i++) {
+        const token_t *tok = &buf.tokens[i];
+        if (tok->type == TOKEN_EOF) {
+            len += snprintf(out + len, size - len, "EOF");
+        } else if (tok->type == TOKEN_WORD) {
+            len += snprintf(out + len, size - len, "WORD(%.*s) ", (int)tok->len, tok->start);
+        } else {
+            len += snprintf(out + len, size - len, "%s ", ops[tok->type]);
+        }
+    }
+    token_buf_free(&buf);
+}
+
+// input through every available backend must match the scalar scanner
+static void check_agree(const char *input) {
+    char want[8192], got[8192];
+
+    set_tokenizer_backend(TOKENIZER_SCALAR);
+    describe(input, want, sizeof(want));
+
+    for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+        if (set_tokenizer_backend(backends[i]) != 0) continue;
+        describe(input, got, sizeof(got));
+        check_total++;
+        if (strcmp(got, want) != 0) {
+            check_failed++;
+            fprintf(stderr, "%s disagrees on \"%s\":\n  scalar: %s\n  %-6s: %s\n",
+                    backend_names[i], input, want, backend_names[i], got);
+        }
+    }
+}
+
+static void check_tokens(const char *input, const char *want) {
+    char got[1024];
+    set_tokenizer_backend(TOKENIZER_SCALAR);
+    describe(input, got, sizeof(got));
+    CHECK_STR(got, want);
+    check_agree(input);
+}
+
+static void test_operators(void) {
+    check_tokens("", "EOF");
+    check_tokens("   \t ", "EOF");
+    check_tokens("ls -l", "WORD(ls) WORD(-l) EOF");
+    check_tokens("a|b||c&d&&e;f", "WORD(a) | WORD(b) || WORD(c) & WORD(d) && WORD(e) ; WORD(f) EOF");
+    check_tokens("cmd > out >> log < in", "WORD(cmd) > WORD(out) >> WORD(log) < WORD(in) EOF");
+    check_tokens("cmd 2> err &> all", "WORD(cmd) 2> WORD(err) &> WORD(all) EOF");
+    check_tokens("cmd 2>err", "WORD(cmd) 2> WORD(err) EOF");
+    check_tokens("echo 2 a2>f", "WORD(echo) WORD(2) WORD(a2) > WORD(f) EOF");
+    check_tokens("(a; b) | c", "( WORD(a) ; WORD(b) ) | WORD(c) EOF");
+}
+
+static void test_quotes(void) {
+    check_tokens("echo \"a b\" 'c|d'", "WORD(echo) WORD(\"a b\") WORD('c|d') EOF");
+    check_tokens("x=\"1 2\"'3 4'y", "WORD(x=\"1 2\"'3 4'y) EOF");
+    check_tokens("echo \"it's\" '\"'", "WORD(echo) WORD(\"it's\") WORD('\"') EOF");
+    check_tokens("echo \"unclosed | x", "WORD(echo) WORD(\"unclosed) | WORD(x) EOF");
+}
+
+// Operators, quotes and spaces at every offset around the 16/32 byte blocks
+static void test_block_edges(void) {
+    static const char *probes[] = {
+        "2>e", "&>x", ">>y", "&&", "||", "|", ";", "\"q r\"", "'s|t'", " \t ", "(z)", "2",
+    };
+    char input[256];
+
+    for (int pad = 0; pad <= 70; pad++) {
+        for (size_t i = 0; i < sizeof(probes) / sizeof(probes[0]); i++) {
+            memset(input, 'a', pad);
+            snprintf(input + pad, sizeof(input) - pad, "%s", probes[i]);
+            check_agree(input);
+
+            // Then a space before it, and more after
+            if (pad > 0) input[pad - 1] = ' ';
+            snprintf(input + pad, sizeof(input) - pad, "%s tail\"x y\"", probes[i]);
+            check_agree(input);
+        }
+    }
+
+    // Quotes that open in one block and close several blocks later
+    memset(input, 'b', 100);
+    input[0] = '"';
+    input[50] = ' ';
+    input[90] = '"';
+    input[100] = '\0';
+    check_agree(input);
+}
+
+// Random lines over the bytes the scanners treat specially
+static void test_random(void) {
+    static const char alphabet[] = "ab2 \t\"'|&;<>()\\=@x";
+    char input[160];
+    unsigned int seed = 12345;
+
+    for (int n = 0; n < 5000; n++) {
+        int len = rand_r(&seed) % (int)sizeof(input);
+        for (int i = 0; i < len; i++) {
+            input[i] = alphabet[rand_r(&seed) % (sizeof(alphabet) - 1)];
+        }
+        input[len] = '\0';
+        check_agree(input);
+    }
+}
+
+int main(void) {
+    test_operators();
+    test_quotes();
+    test_block_edges();
+    test_random();
+    return check_summary("tokenizer");
+}
@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "variables.h"
+#include "check.h"
+
+// Same djb2 as the table, to build names that collide on purpose
+static unsigned int name_hash(const char *name) {
+    unsigned int hash = 5381;
+    for (const unsigned char *c = (const unsigned char *)name; *c; c++) {
+        hash = ((hash << 5) + hash) + *c;
+    }
+    return hash ? hash : 1;
+}
+
+// count names that all land in the same home slot of a fresh table
+static void colliding_names(char names[][16], int count) {
+    unsigned int mask = VAR_TABLE_MIN_SLOTS - 1;
+    unsigned int home = name_hash("c0") & mask;
+    int found = 0;
+
+    for (int i = 0; found < count; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "c%d", i);
+        if ((name_hash(name) & mask) == home) {
+            strcpy(names[found++], name);
+        }
+    }
+}
+
+static void check_value(const char *name, const char *want) {
+    const char *got = get_variable(name);
+    check_total++;
+    if (want ? !got || strcmp(got, want) != 0 : got != NULL) {
+        check_failed++;
+        fprintf(stderr, "%s is \"%s\", want \"%s\"\n", name,
+                got ? got : "(unset)", want ? want : "(unset)");
+    }
+}
+
+static void test_cluster(void) {
+    char names[8][16];
+    colliding_names(names, 8);
+
+    for (int i = 0; i < 8; i++) {
+        CHECK(set_variable(names[i], names[i], 0) == 0);
+    }
+    for (int i = 0; i < 8; i++) {
+        check_value(names[i], names[i]);
+    }
+
+    // Deleting the head and the middle shifts the rest back: every
+    // survivor must still be reachable, with no tombstone in the way
+    CHECK(unset_variable(names[0]) == 0);
+    CHECK(unset_variable(names[4]) == 0);
+    CHECK(unset_variable(names[4]) == -1);
+    for (int i = 0; i < 8; i++) {
+        check_value(names[i], i == 0 || i == 4 ? NULL : names[i]);
+    }
+
+    // A colliding name that was never set stops the probe early
+    char absent[16];
+    for (int i = 100000; ; i++) {
+        snprintf(absent, sizeof(absent), "c%d", i);
+        if ((name_hash(absent) & (VAR_TABLE_MIN_SLOTS - 1)) ==
+            (name_hash(names[0]) & (VAR_TABLE_MIN_SLOTS - 1))) break;
+    }
+    check_value(absent, NULL);
+
+    // Back in, with new values; updating keeps one entry per name
+    CHECK(set_variable(names[0], "again", 0) == 0);
+    CHECK(set_variable(names[4], "again", 0) == 0);
+    CHECK(set_variable(names[4], "updated", 0) == 0);
+    check_value(names[0], "again");
+    check_value(names[4], "updated");
+    for (int i = 0; i < 8; i++) {
+        CHECK(unset_variable(names[i]) == 0);
+        check_value(names[i], NULL);
+    }
+}
+
+static void test_rehash(void) {
+    char name[32], value[32];
+    const int count = 2000;     // several doublings from VAR_TABLE_MIN_SLOTS
+
+    for (int i = 0; i < count; i++) {
+        snprintf(name, sizeof(name), "grow_%d", i);
+        snprintf(value, sizeof(value), "v%d", i);
+        CHECK(set_variable(name, value, i % 3 == 0) == 0);
+    }
+    for (int i = 0; i < count; i++) {
+        snprintf(name, sizeof(name), "grow_%d", i);
+        snprintf(value, sizeof(value), "v%d", i);
+        check_value(name, value);
+    }
+
+    // Unset half, then refill: tombstones get compacted away
+    for (int i = 0; i < count; i += 2) {
+        snprintf(name, sizeof(name), "grow_%d", i);
+        CHECK(unset_variable(name) == 0);
+    }
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < count; i += 2) {
+            snprintf(name, sizeof(name), "grow_%d", i);
+            snprintf(value, sizeof(value), "r%d", round);
+            CHECK(set_variable(name, value, 0) == 0);
+        }
+        for (int i = 0; i < count; i += 2) {
+            snprintf(name, sizeof(name), "grow_%d", i);
+            CHECK(unset_variable(name) == 0);
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        snprintf(name, sizeof(name), "grow_%d", i);
+        snprintf(value, sizeof(value), "v%d", i);
+        check_value(name, i % 2 ? value : NULL);
+    }
+}
+
+static void test_long_names(void) {
+    // Past VAR_INLINE_NAME the name lives on the heap
+    char name[MAX_VAR_NAME];
+    memset(name, 'x', sizeof(name) - 1);
+    name[sizeof(name) - 1] = '\0';
+
+    CHECK(set_variable(name, "long", 0) == 0);
+    check_value(name, "long");
+    name[VAR_INLINE_NAME] = '\0';
+    check_value(name, NULL);
+    CHECK(set_variable(name, "shorter", 0) == 0);
+    check_value(name, "shorter");
+    CHECK(unset_variable(name) == 0);
+    name[VAR_INLINE_NAME] = 'x';
+    check_value(name, "long");
+}
+
+int main(void) {
+    clearenv();     // a table that starts at VAR_TABLE_MIN_SLOTS
+    init_variables();
+    test_cluster();
+    test_rehash();
+    test_long_names();
+    cleanup_variables();
+    return check_summary("variables");
+}
@@ -0,0 +1,75 @@
+// Build-time generator for the builtin lookup table.
+//
+// Searches for a seed that gives every name in BUILTIN_LIST its own slot
+// in a power-of-two table (at least twice the number of builtins), then
+// prints a header with the seed and the slot -> builtin index map.
+// Run by the Makefile: gen_builtin_hash > obj/builtin_hash.h
+
+#include <stdio.h>
+#include <string.h>
+#include "builtin_table.h"
+
+#define MAX_SEEDS 1000000u
+#define MAX_SLOTS 1024
+
+#define BUILTIN_NAME(name, fn, flags) name,
+static const char *names[] = { BUILTIN_LIST(BUILTIN_NAME) };
+#define BUILTIN_COUNT ((int)(sizeof(names) / sizeof(names[0])))
+
+static int try_seed(unsigned int seed, unsigned int mask, int *slots) {
+    for (unsigned int i = 0; i <= mask; i++) {
+        slots[i] = -1;
+    }
+    for (int i = 0; i < BUILTIN_COUNT; i++) {
+        unsigned int slot = builtin_name_hash(names[i], seed) & mask;
+        if (slots[slot] != -1) {
+            return 0;
+        }
+        slots[slot] = i;
+    }
+    return 1;
+}
+
+int main(void) {
+    static int slots[MAX_SLOTS];
+    int bits = 1;
+
+    // Duplicate names would never hash apart
+    for (int i = 0; i < BUILTIN_COUNT; i++) {
+        for (int j = i + 1; j < BUILTIN_COUNT; j++) {
+            if (strcmp(names[i], names[j]) == 0) {
+                fprintf(stderr, "gen_builtin_hash: duplicate builtin '%s'\n", names[i]);
+                return 1;
+            }
+        }
+    }
+
+    while ((1 << bits) < 2 * BUILTIN_COUNT) {
+        bits++;
+    }
+
+    // Grow the table if no seed works at this size
+    for (; (1 << bits) <= MAX_SLOTS; bits++) {
+        unsigned int mask = (1u << bits) - 1;
+        for (unsigned int seed = 0; seed < MAX_SEEDS; seed++) {
+            if (!try_seed(seed, mask, slots)) {
+                continue;
+            }
+
+            printf("// Generated by tools/gen_builtin_hash.c from include/builtin_table.h\n");
+            printf("#ifndef BUILTIN_HASH_H\n#define BUILTIN_HASH_H\n\n");
+            printf("#define BUILTIN_HASH_SEED %uu\n", seed);
+            printf("#define BUILTIN_HASH_BITS %d\n\n", bits);
+            printf("// Slot -> position in BUILTIN_LIST, -1 when empty\n");
+            printf("static const signed char builtin_slot_index[%u] = {", mask + 1);
+            for (unsigned int i = 0; i <= mask; i++) {
+                printf("%s%s%d", i ? "," : "", i % 16 == 0 ? "\n    " : " ", slots[i]);
+            }
+            printf("\n};\n\n#endif\n");
+            return 0;
+        }
+    }
+
+    fprintf(stderr, "gen_builtin_hash: no perfect hash found for %d builtins\n", BUILTIN_COUNT);
+    return 1;
+}